@@ -1,94 +1,971 @@
 #include "blend.h"
 #include "advertiser_scanner.h"
+#include "neighbor.h"
+#include "blend_jitter.h"
+#include "blend_trace.h"
+#include "blend_energy.h"
+
+#include <limits.h>
 
 LOG_MODULE_REGISTER(BLEnd_NONCONN_BLEND, LOG_LEVEL_INF);
-static int epoch_period,adv_duration, scan_duration;
-/* timer and workqueue handlers
-    * These handlers are used to manage the timing of advertising and scanning operations.
-    * The epoch timer triggers the start of a new epoch, while the adv and scan timers handle
-    * the duration of advertising and scanning respectively.
+
+/* BLEnd epoch state machine
+    * A single one-shot timer drives the whole epoch. Every expiry is armed on an absolute
+    * tick deadline computed from the nominal epoch start (scan -> advertise -> next epoch), so ISR
+    * and workqueue latency can delay one transition but never shifts the ones after it.
+    * The controller ends the scan window on its own timeout and the advertising window after a
+    * fixed number of events, and the advertising window is chained from the scan timeout callback.
+    * Neither end needs a timer expiry, so the state machine stays in BLEND_STATE_SCAN from the
+    * start of the scan to the next epoch.
+    * In B-BLEnd mode the scan opens together with a single lead beacon (BLEND_STATE_LEAD). The
+    * timer starts the advertising window one 10 ms unit before the scan ends, and the controller
+    * ends the window on its timeout just before the next epoch (BLEND_STATE_ADV).
+    * With CONFIG_BLEND_SYNC, epochs in which every tracked neighbor can be predicted run as
+    * maintenance epochs instead (BLEND_STATE_MAINT): a short scan around the predicted beacons
+    * and an advertising window started by the timer, since no full scan precedes it.
+*/
+enum blend_state {
+    BLEND_STATE_STOPPED,
+    BLEND_STATE_LEAD,
+    BLEND_STATE_SCAN,
+    BLEND_STATE_ADV,
+    BLEND_STATE_MAINT,
+    BLEND_STATE_SHIFT,
+};
+
+/* Group sync
+    * Nodes with the same epoch length move their grid onto the grid of the neighbor with the
+    * lowest address, estimated from the beacon's phase offset. Once the grid is shared, the
+    * next beacon of every tracked neighbor is predicted from the first beacon heard in its last
+    * window, and the next epoch only scans around those predictions. Every
+    * CONFIG_BLEND_SYNC_FULL_SCAN_PERIOD epochs the usual discovery scan is added for nodes
+    * outside the group, and after a tracked neighbor is missed the scan at the predictions is
+    * widened to a full advertising interval. A grid shift is followed by an ordinary epoch.
+    * The plan is computed on the system workqueue during the epoch before the one it is for.
 */
-static void epoch_timer_handler(struct k_timer *timer_id);
-static void adv_timeout_timer_handler(struct k_timer *timer_id);
-static void scan_timeout_timer_handler(struct k_timer *timer_id);
+struct blend_sync_plan {
+    uint32_t epoch;     // epoch the plan is for
+    bool valid;
+    bool maint;         // run the epoch as a maintenance epoch
+    int shift_ms;       // delay the start of the epoch by this much to join the leader's grid
+    int scan_start_ms;  // maintenance scan window within the epoch
+    int scan_ms;
+};
+
+#define BLEND_SYNC_TOLERANCE_MS (CONFIG_BLEND_SYNC_GUARD_MS / 2)
+
+/* pending steps of a maintenance epoch */
+#define BLEND_MAINT_SCAN BIT(0)
+#define BLEND_MAINT_ADV BIT(1)
+
+/* B-BLEnd: the advertising window ends on the controller's 10 ms timeout at least this long before
+ * the next lead beacon, and the scan runs on for one 10 ms unit after the window has started */
+#define BLEND_TRAIL_GUARD_MS 2
+#define BLEND_SCAN_OVERLAP_MS 10
 
-K_TIMER_DEFINE(epoch_timer, epoch_timer_handler, NULL);
-K_TIMER_DEFINE(adv_timeout_timer, adv_timeout_timer_handler, NULL);
-K_TIMER_DEFINE(scan_timeout_timer, scan_timeout_timer_handler, NULL);
+/* Epoch layout of one (E, A) pair, see blend_init */
+struct blend_layout {
+    int epoch_period, adv_interval;
+    enum blend_phy phy;
+    uint8_t channels;
+    int scan_channel_ms;
+    int lead_duration, adv_duration, scan_duration, adv_phase;
+    int lead_events, adv_events;
+};
+
+static enum blend_mode blend_mode;
+/* radio slack of the layout; the airtime is set from the profile by blend_init and blend_phy_set,
+ * the delay is the worst case until blend_margins_set */
+static struct blend_margins margins = {
+    .adv_delay_max_us = BLEND_ADV_DELAY_MAX_US,
+    .adv_delay_mean_us = BLEND_ADV_DELAY_MAX_US / 2,
+};
+static int epoch_period, lead_duration, adv_duration, scan_duration;
+static int adv_interval_cur;
+/* radio profile and channel map of the set, and the ones new layouts are computed for */
+static enum blend_phy phy_cur, phy_req;
+static uint8_t channels_cur, channels_req = BLEND_CHAN_ALL;
+/* layout requested by blend_retune, applied at the next epoch boundary */
+static struct blend_layout retune_layout;
+static atomic_t retune_pending;
+/* start of the advertising window after the scan, within the epoch: the controller ends the
+ * scan on a 10 ms boundary */
+static int adv_phase;
+/* advertising events sent in the lead window and in the window after the scan, 0 for a window
+ * ended by its duration */
+static int lead_events, adv_events;
+
+/* phase boundaries as tick offsets from the epoch start */
+static k_ticks_t epoch_ticks, adv_start_ticks;
+/* nominal (grid) start of the current epoch and the deadline the timer is armed for */
+static k_ticks_t epoch_start, deadline;
+/* epochs since boot, including skipped ones; never reset so it can tag neighbor sightings */
+static uint32_t epoch_count;
+static enum blend_state state = BLEND_STATE_STOPPED;
+static struct blend_timing_stats timing_stats;
+/* cycle count on entry to the timer handler, for the jitter benchmark */
+static uint32_t timer_cyc;
+
+static struct blend_sync_plan sync_plan;
+static bt_addr_le_t own_addr;
+/* maintenance epoch: scan window, steps still to run and the step the timer is armed for */
+static k_ticks_t maint_scan_ticks;
+static int maint_scan_ms;
+static uint32_t maint_pending, maint_next;
+
+static void blend_timer_handler(struct k_timer *timer_id);
+static void blend_sync_plan_handler(struct k_work *work);
+static void blend_retune_apply(void);
+
+K_TIMER_DEFINE(blend_timer, blend_timer_handler, NULL);
+K_WORK_DEFINE(sync_plan_work, blend_sync_plan_handler);
+
+/* Radio-control workqueue
+    * The BLEnd work items run on their own cooperative thread instead of the shared system
+    * workqueue, so slow items there cannot delay a radio transition. The cycle count at submission
+    * is kept to measure the queueing delay until the handler starts.
+*/
+static K_THREAD_STACK_DEFINE(blend_workq_stack, CONFIG_BLEND_WORKQ_STACK_SIZE);
+static struct k_work_q blend_workq;
+static const struct k_work_queue_config blend_workq_config = {
+    .name = "blend_workq",
+};
+static bool blend_workq_started;
+static uint32_t submit_cyc;
+static atomic_t submit_pending;
 
 /**
- * @brief Handler for the advertising timeout timer
+ * @brief Submits a radio work item to the BLEnd workqueue
  *
- * This function is called when the advertising timeout timer expires. It stops the advertising process
- * and starts the scan process.
+ * @param work Work item to submit
+ */
+static void blend_submit(struct k_work *work)
+{
+    submit_cyc = k_cycle_get_32();
+    atomic_set(&submit_pending, 1);
+    k_work_submit_to_queue(&blend_workq, work);
+}
+
+/**
+ * @brief Records the queueing delay of the radio work item that has just started
  *
- * @param timer_id Pointer to the timer that triggered this handler
+ * Called by the scan and advertising work handlers before they touch the radio.
  */
-static void adv_timeout_timer_handler(struct k_timer *timer_id)
+void blend_work_begin(void)
 {
-    LOG_INF(" enter adv_timeout_timer_handler");
-	// Stop advertising after broadcasting is done
-   k_work_submit(&adv_stop);
-   
+    uint32_t delay_cyc, delay_us;
+    unsigned int key;
+
+    if (!atomic_cas(&submit_pending, 1, 0)) {
+        return;
+    }
+    delay_cyc = k_cycle_get_32() - submit_cyc;
+    delay_us = k_cyc_to_us_floor32(delay_cyc);
+    if (IS_ENABLED(CONFIG_BLEND_JITTER)) {
+        blend_jitter_record(BLEND_JITTER_WORK, (int32_t)delay_cyc);
+    }
+
+    key = irq_lock();
+    timing_stats.workq_count++;
+    timing_stats.workq_last_us = delay_us;
+    timing_stats.workq_sum_us += delay_us;
+    timing_stats.workq_max_us = MAX(timing_stats.workq_max_us, delay_us);
+    irq_unlock(key);
 }
 
 /**
- * @brief Handler for the scan timeout timer
+ * @brief Submits a work item of another module to the BLEnd workqueue
  *
- * This function is called when the scan timeout timer expires. It stops the scanning process
- * and starts the advertising process.
+ * For radio work outside the epoch schedule, such as payload updates. It runs in order with the
+ * scan and advertising work and is not counted in the queueing statistics.
  *
- * @param timer_id Pointer to the timer that triggered this handler
+ * @param work Work item to submit
+ */
+void blend_radio_submit(struct k_work *work)
+{
+    k_work_submit_to_queue(&blend_workq, work);
+}
+
+/**
+ * @brief Arms the state machine timer for the next phase boundary
+ *
+ * @param offset Tick offset of the boundary from the start of the current epoch
+ */
+static void blend_arm(k_ticks_t offset)
+{
+    deadline = epoch_start + offset;
+    k_timer_start(&blend_timer, K_TIMEOUT_ABS_TICKS(deadline), K_NO_WAIT);
+}
+
+/**
+ * @brief Records how late the current transition fired compared with its deadline
+ *
+ * @param late Lateness in ticks
+ * @param epoch_boundary true when the transition starts a new epoch
+ */
+static void blend_timing_update(k_ticks_t late, bool epoch_boundary)
+{
+    uint32_t late_us = (uint32_t)k_ticks_to_us_floor64(late > 0 ? late : 0);
+
+    timing_stats.transitions++;
+    timing_stats.last_late_us = late_us;
+    timing_stats.sum_late_us += late_us;
+    timing_stats.max_late_us = MAX(timing_stats.max_late_us, late_us);
+    if (epoch_boundary) {
+        timing_stats.epochs++;
+        timing_stats.max_epoch_late_us = MAX(timing_stats.max_epoch_late_us, late_us);
+    }
+    if (IS_ENABLED(CONFIG_BLEND_JITTER)) {
+        blend_jitter_transition(epoch_boundary, timer_cyc, deadline);
+    }
+}
+
+/**
+ * @brief Sets the schedule the next advertising window carries in its beacons
+ *
+ * @param phase_ms Start of the window within the epoch
+ * @param window_ms Longest the window can last
+ */
+static void blend_schedule_set(int phase_ms, int window_ms)
+{
+    struct neighbor_beacon schedule = {
+        .epoch = (uint16_t)epoch_count,
+        .epoch_ms = epoch_period,
+        .phase_ms = phase_ms,
+        .window_ms = window_ms,
+    };
+
+    adv_schedule_set(&schedule);
+}
+
+/**
+ * @brief Starts the scan phase of the current epoch
+ *
+ * The advertising window that follows the scan is started by the scanner itself when the
+ * controller reports the scan timeout, so the next deadline is the next epoch.
+ */
+static void blend_enter_scan(void)
+{
+    state = BLEND_STATE_SCAN;
+    scan_window_set(scan_duration, true);
+    adv_window_set(adv_events, adv_duration);
+    blend_schedule_set(adv_phase, adv_duration);
+    blend_submit(&scan_work);
+    blend_arm(epoch_ticks);
+}
+
+/**
+ * @brief Starts the advertising window of a B-BLEnd epoch
+ *
+ * The scan is still open for one more 10 ms unit. The controller ends the window on its timeout
+ * just before the next epoch, so the next deadline is the next epoch.
+ */
+static void blend_enter_adv(void)
+{
+    state = BLEND_STATE_ADV;
+    adv_window_set(adv_events, adv_duration);
+    blend_schedule_set(adv_phase, adv_duration);
+    blend_submit(&adv_work);
+    blend_arm(epoch_ticks);
+}
+
+/**
+ * @brief Arms the timer for the next step of a maintenance epoch
+ *
+ * The scan and the advertising window are armed in the order of their offsets, then the
+ * end of the epoch.
  */
-static void scan_timeout_timer_handler(struct k_timer *timer_id)
+static void blend_maint_next(void)
 {
-	LOG_INF(" enter scan_timeout_timer_handler");
-	k_work_submit(&scan_stop);
-	k_work_submit(&adv_work);
-	k_timer_start(&adv_timeout_timer, K_MSEC(adv_duration), K_NO_WAIT);
-    LOG_INF("adv timeout timer started");
+    if ((maint_pending & BLEND_MAINT_SCAN) &&
+        (!(maint_pending & BLEND_MAINT_ADV) || maint_scan_ticks <= adv_start_ticks)) {
+        maint_next = BLEND_MAINT_SCAN;
+        blend_arm(maint_scan_ticks);
+    } else if (maint_pending & BLEND_MAINT_ADV) {
+        maint_next = BLEND_MAINT_ADV;
+        blend_arm(adv_start_ticks);
+    } else {
+        maint_next = 0;
+        blend_arm(epoch_ticks);
+    }
 }
 
 /**
- * @brief Handler for the epoch timer
+ * @brief Runs the step of a maintenance epoch the timer was armed for
+ */
+static void blend_maint_step(void)
+{
+    if (maint_next == BLEND_MAINT_SCAN) {
+        // the advertising window is started by the timer, not chained from the scan
+        scan_window_set(maint_scan_ms, false);
+        blend_submit(&scan_work);
+    } else {
+        adv_window_set(adv_events, adv_duration);
+        blend_schedule_set(adv_phase, adv_duration);
+        blend_submit(&adv_work);
+    }
+    maint_pending &= ~maint_next;
+    blend_maint_next();
+}
+
+/**
+ * @brief Starts a maintenance epoch
  *
- * This function is called when the epoch timer expires. It starts the scanning process
- * and sets up the scan timeout timer.
+ * The short scan overlaps the advertising windows of the group and of this node, so it relies
+ * on the controller interleaving scanning with its own advertising events.
+ *
+ * @param plan Plan of the epoch
+ */
+static void blend_enter_maint(const struct blend_sync_plan *plan)
+{
+    state = BLEND_STATE_MAINT;
+    if (plan->scan_ms < scan_duration) {
+        timing_stats.maintenance_epochs++;
+    }
+    maint_scan_ticks = k_ms_to_ticks_floor64(plan->scan_start_ms);
+    maint_scan_ms = plan->scan_ms;
+    maint_pending = BLEND_MAINT_SCAN | BLEND_MAINT_ADV;
+    if (lead_events != 0) {
+        adv_window_set(lead_events, lead_duration);
+        blend_schedule_set(0, lead_duration);
+        blend_submit(&adv_work);
+    }
+    blend_maint_next();
+}
+
+/**
+ * @brief Returns the sync plan for the current epoch, if there is one
+ *
+ * @param plan Destination for the plan
+ *
+ * @retval true If a plan for the current epoch was found.
+ */
+static bool blend_sync_plan_get(struct blend_sync_plan *plan)
+{
+    if (!IS_ENABLED(CONFIG_BLEND_SYNC)) {
+        return false;
+    }
+    *plan = sync_plan;
+    return plan->valid && plan->epoch == epoch_count;
+}
+
+/**
+ * @brief Starts the first phase of the current epoch
+ *
+ * In B-BLEnd mode the scan opens together with the lead beacon, and the controller interleaves
+ * the two; in U-BLEnd mode the epoch opens with the scan alone.
+ * In sync mode the epoch may run as a maintenance epoch instead. Either way the plan for the
+ * next epoch is computed while this one runs.
+ */
+static void blend_enter_epoch(void)
+{
+    struct blend_sync_plan plan;
+
+    if (IS_ENABLED(CONFIG_BLEND_SYNC)) {
+        k_work_submit(&sync_plan_work);
+    }
+    if (blend_sync_plan_get(&plan) && plan.maint) {
+        blend_enter_maint(&plan);
+        return;
+    }
+    if (lead_events == 0) {
+        blend_enter_scan();
+        return;
+    }
+    state = BLEND_STATE_LEAD;
+    adv_window_set(lead_events, lead_duration);
+    blend_schedule_set(0, lead_duration);
+    scan_window_set(adv_phase + BLEND_SCAN_OVERLAP_MS, false);
+    blend_submit(&adv_work);
+    blend_submit(&scan_work);
+    blend_arm(adv_start_ticks);
+}
+
+/**
+ * @brief Moves the grid to the next epoch
+ *
+ * @param late Lateness of the boundary in ticks
+ */
+static void blend_epoch_boundary(k_ticks_t late)
+{
+    struct blend_sync_plan plan;
+
+    blend_timing_update(late, true);
+    epoch_start += epoch_ticks;
+    // if we fell more than a whole epoch behind, skip the lost epochs and stay on the grid
+    epoch_count++;
+    while (late >= epoch_ticks) {
+        epoch_start += epoch_ticks;
+        late -= epoch_ticks;
+        epoch_count++;
+        timing_stats.skipped_epochs++;
+    }
+    blend_retune_apply();
+    neighbor_epoch_boundary(epoch_count);
+    if (IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+        blend_energy_epoch(epoch_count);
+    }
+    if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+        blend_trace_epoch(epoch_count, timing_stats.last_late_us);
+    }
+    if (blend_sync_plan_get(&plan) && plan.shift_ms > 0) {
+        // join the leader's grid: this epoch starts later by the shift
+        epoch_start += k_ms_to_ticks_ceil64(plan.shift_ms);
+        timing_stats.sync_shifts++;
+        state = BLEND_STATE_SHIFT;
+        blend_arm(0);
+        return;
+    }
+    blend_enter_epoch();
+}
+
+/**
+ * @brief Handler for the state machine timer
+ *
+ * This function is called at every phase boundary. It submits the radio work for the phase
+ * that has just begun and re-arms the timer on the next absolute deadline.
  *
  * @param timer_id Pointer to the timer that triggered this handler
  */
-static void epoch_timer_handler(struct k_timer *timer_id)
+static void blend_timer_handler(struct k_timer *timer_id)
 {
-    LOG_INF(" enter epoch_timer_handler");
-       k_work_submit(&scan_work);
-	   k_timer_start(&scan_timeout_timer, K_MSEC(scan_duration), K_NO_WAIT);
-       LOG_INF("scan timeout timer started");
+    k_ticks_t late;
+
+    timer_cyc = k_cycle_get_32();
+    late = k_uptime_ticks() - deadline;
+
+    switch (state) {
+    case BLEND_STATE_LEAD:
+        // the controller has already ended the lead window
+        blend_timing_update(late, false);
+        blend_enter_adv();
+        break;
+    case BLEND_STATE_SCAN:
+    case BLEND_STATE_ADV:
+        blend_epoch_boundary(late);
+        break;
+    case BLEND_STATE_MAINT:
+        if (maint_next == 0) {
+            blend_epoch_boundary(late);
+            break;
+        }
+        blend_timing_update(late, false);
+        blend_maint_step();
+        break;
+    case BLEND_STATE_SHIFT:
+        blend_timing_update(late, false);
+        blend_enter_epoch();
+        break;
+    default:
+        break;
+    }
 }
 
+/* neighbors seen by one sync planning pass */
+struct blend_sync_ctx {
+    uint32_t epoch;          // epoch being planned
+    int64_t start_ms;        // nominal start of that epoch
+    int lo_ms, hi_ms;        // earliest and latest predicted beacon within the epoch
+    int tracked;
+    bool missed;
+    bt_addr_le_t leader;
+    int64_t leader_start_ms; // estimated epoch start of the leader
+};
+
 /**
- * @brief Initializes the BLEnd module
+ * @brief Adds one neighbor to the sync plan
+ *
+ * Neighbors with another epoch length cannot share the grid and neighbors not heard for a
+ * full-scan period are no longer tracked, so both are left out.
+ */
+static void blend_sync_visit(const struct neighbor *n, void *user_data)
+{
+    struct blend_sync_ctx *ctx = user_data;
+    int64_t beacon_ms;
+    int offset;
+
+    if (n->schedule.epoch_ms != epoch_period ||
+        ctx->epoch - n->last_epoch > CONFIG_BLEND_SYNC_FULL_SCAN_PERIOD) {
+        return;
+    }
+    ctx->tracked++;
+    // every tracked neighbor should have been heard in the epoch that has just ended
+    if ((int32_t)(ctx->epoch - 2 - n->last_epoch) > 0) {
+        ctx->missed = true;
+    }
+    // the next beacon is expected one epoch after the first beacon heard in the last window
+    beacon_ms = n->next_window_max;
+    while (beacon_ms < ctx->start_ms - CONFIG_BLEND_SYNC_GUARD_MS) {
+        beacon_ms += epoch_period;
+    }
+    offset = (int)(beacon_ms - ctx->start_ms);
+    ctx->lo_ms = MIN(ctx->lo_ms, offset);
+    ctx->hi_ms = MAX(ctx->hi_ms, offset);
+    if (bt_addr_le_cmp(&n->addr, &ctx->leader) < 0) {
+        bt_addr_le_copy(&ctx->leader, &n->addr);
+        ctx->leader_start_ms = beacon_ms - n->schedule.phase_ms;
+    }
+}
+
+/**
+ * @brief Computes the sync plan for the next epoch
+ *
+ * @param *work Work item of the planner
+ */
+static void blend_sync_plan_handler(struct k_work *work)
+{
+    struct blend_sync_ctx ctx = {
+        .lo_ms = INT_MAX,
+        .hi_ms = INT_MIN,
+    };
+    struct blend_sync_plan plan = { 0 };
+    unsigned int key;
+    int delta, start, end;
+
+    bt_addr_le_copy(&ctx.leader, &own_addr);
+    key = irq_lock();
+    ctx.epoch = epoch_count + 1;
+    ctx.start_ms = k_ticks_to_ms_floor64(epoch_start + epoch_ticks);
+    irq_unlock(key);
+
+    neighbor_foreach(blend_sync_visit, &ctx);
+
+    plan.epoch = ctx.epoch;
+    plan.valid = true;
+    if (!bt_addr_le_eq(&ctx.leader, &own_addr)) {
+        // delay our grid by the leader's offset modulo the epoch, unless we are already on it
+        delta = (int)(((ctx.leader_start_ms - ctx.start_ms) % epoch_period + epoch_period) % epoch_period);
+        if (MIN(delta, epoch_period - delta) > BLEND_SYNC_TOLERANCE_MS) {
+            plan.shift_ms = delta;
+        }
+    }
+    if (ctx.tracked > 0 && plan.shift_ms == 0) {
+        start = MAX(ctx.lo_ms - CONFIG_BLEND_SYNC_GUARD_MS, 0);
+        end = ctx.hi_ms + CONFIG_BLEND_SYNC_GUARD_MS + DIV_ROUND_UP(margins.airtime_us, 1000);
+        if (ctx.missed) {
+            // a full interval at the prediction hears the neighbor if its window is still there
+            end = MAX(end, start + scan_duration);
+        }
+        if (ctx.epoch % CONFIG_BLEND_SYNC_FULL_SCAN_PERIOD == 0) {
+            start = 0;
+            end = MAX(end, scan_duration);
+        }
+        // the short scan cannot pick its channel, so a channel subset keeps the full scans
+        plan.maint = end < epoch_period && channels_cur == BLEND_CHAN_ALL;
+        plan.scan_start_ms = start;
+        plan.scan_ms = end - start;
+    }
+
+    key = irq_lock();
+    sync_plan = plan;
+    irq_unlock(key);
+    LOG_DBG("sync plan for epoch %u: %s, %d tracked, shift %d ms, scan %d ms at %d ms",
+            plan.epoch, plan.maint ? "maintenance" : "ordinary", ctx.tracked, plan.shift_ms,
+            plan.scan_ms, plan.scan_start_ms);
+}
+
+/**
+ * @brief Computes the epoch layout for a parameter pair
+ *
+ * The scan is one interval plus the longest random delay and one advertising event, so it always
+ * holds a full beacon of a neighbor that is advertising. The controller moves the scan to the
+ * next primary channel after each such window, so with k advertising channels 4 - k windows
+ * in a row visit at least one of them. The window after it counts beacons at
+ * the mean interval A + mean delay, and its length is an upper bound with every interval at its
+ * longest. The slack comes from the current margins, see blend_margins_set.
+ *
+ * B-BLEnd beacons on both sides of the scan instead: one lead beacon as the scan opens, then a
+ * window from the end of the scan to BLEND_TRAIL_GUARD_MS before the next epoch. Outside its scan
+ * a node then beacons at most one interval, the longest delay, the guard and the 10 ms timeout
+ * unit apart, so each scan window is longer by the guard and the unit and holds a full beacon of
+ * any node that is not scanning itself. When two scans overlap, the later node's lead beacon falls
+ * in the earlier scan, and the earlier node's first beacon after the scan falls in the later scan,
+ * which is why the scan runs on for BLEND_SCAN_OVERLAP_MS. Either way two nodes hear each other in
+ * the same epoch unless their beacons overlap in time. Those beacons can land in any of the scan
+ * windows, so every channel the scan visits must carry beacons: all three, or 37 and 38.
  *
  * @param epoch_duration Duration of the epoch in milliseconds
  * @param adv_interval Advertising interval in 0.625 milliseconds
+ * @param mode Discovery mode, U-BLEnd or B-BLEnd
+ * @param l Destination for the layout
+ *
+ * @retval 0 If the active period fits in the epoch.
+ *           Otherwise, a (negative) error code is returned.
  */
-void blend_init(int epoch_duration, int adv_interval)
+static int blend_layout_compute(int epoch_duration, int adv_interval, enum blend_mode mode,
+                                struct blend_layout *l)
 {
     int adv_interval_count;
-    epoch_period = epoch_duration;
-    scan_duration = adv_interval* 0.625 +10 + 5;	//one adv_interval + 10ms random delay + 5ms for one advertising packet length
-    adv_interval_count = (epoch_duration/2 - scan_duration)/(adv_interval* 0.625 +5);   //an average random delay of 5ms
+    uint32_t interval_us = adv_interval * 625;
+    uint32_t avg_interval_us = interval_us + margins.adv_delay_mean_us;
+
+    if (epoch_duration <= 0 || epoch_duration > UINT16_MAX) {
+        // the beacons carry the epoch length in 16 bits
+        LOG_ERR("epoch_period %d ms out of range", epoch_duration);
+        return -EINVAL;
+    }
+    l->epoch_period = epoch_duration;
+    l->adv_interval = adv_interval;
+    l->phy = phy_req;
+    l->channels = channels_req;
+    //one adv_interval + the longest random delay + one advertising event, per scanned channel
+    l->scan_channel_ms = DIV_ROUND_UP(interval_us + margins.adv_delay_max_us + margins.airtime_us, 1000);
+    if (mode == BLEND_MODE_BIDIRECTIONAL) {
+        // the gap from the last beacon of the window to the next lead beacon
+        l->scan_channel_ms += BLEND_TRAIL_GUARD_MS + 10;
+    }
+    l->scan_duration = (4 - POPCOUNT(l->channels)) * l->scan_channel_ms;
+    adv_interval_count = (epoch_duration/2 - l->scan_duration) * 1000LL / avg_interval_us;
     adv_interval_count += 1;    //one "incomplete" interval
-    adv_duration = adv_interval_count * (adv_interval * 0.625 +5) + 15 ; // 15 ms for the last beacon's transmission 
-    LOG_INF("BLEnd init: epoch_period %d ms, adv_duration %d ms, scan_duration %d ms", epoch_period, adv_duration, scan_duration);
+    l->adv_events = adv_interval_count + 1;    // a beacon at the start of every interval and one at the end
+    // upper bound only, the window normally ends after adv_events: every interval at its
+    // longest plus the last beacon's transmission
+    l->adv_duration = DIV_ROUND_UP((uint64_t)adv_interval_count * (interval_us + margins.adv_delay_max_us) +
+                                   margins.airtime_us, 1000);
+    l->lead_duration = 0;
+    l->lead_events = 0;
+    l->adv_phase = ROUND_UP(l->scan_duration, 10);
+    if (mode == BLEND_MODE_BIDIRECTIONAL) {
+        // the scan visits channel 37 first, then 38 and 39
+        uint8_t scanned = BIT(4 - POPCOUNT(l->channels)) - 1;
+
+        if ((l->channels & scanned) != scanned) {
+            LOG_ERR("B-BLEnd needs beacons on every scanned channel, not map 0x%02x", l->channels);
+            return -EINVAL;
+        }
+        l->lead_events = 1;
+        l->lead_duration = DIV_ROUND_UP(margins.airtime_us, 1000);
+        // beacons from the end of the scan until the guard before the next epoch
+        l->adv_events = 0;
+        l->adv_duration = (epoch_duration - l->adv_phase - BLEND_TRAIL_GUARD_MS) / 10 * 10;
+        if (l->adv_duration < l->scan_duration) {
+            LOG_ERR("epoch_period %d ms too short for B-BLEnd", epoch_duration);
+            return -EINVAL;
+        }
+        return 0;
+    }
+    if (l->adv_phase + l->adv_duration >= epoch_duration) {
+        LOG_ERR("active period (%d ms) does not fit in the epoch", l->adv_phase + l->adv_duration);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/**
+ * @brief Makes a layout the one the state machine runs
+ *
+ * @param l Layout computed by blend_layout_compute
+ */
+static void blend_layout_apply(const struct blend_layout *l)
+{
+    if (l->phy != phy_cur || l->channels != channels_cur || l->adv_interval != adv_interval_cur) {
+        // the set is idle at the boundary; the new parameters are in place before the next window
+        adv_phy_set(l->phy);
+        adv_channels_set(l->channels);
+        adv_interval_set(l->adv_interval);
+        k_work_submit_to_queue(&blend_workq, &adv_param_work);
+        phy_cur = l->phy;
+        channels_cur = l->channels;
+    }
+    scan_channel_window_set(l->scan_channel_ms);
+    epoch_period = l->epoch_period;
+    adv_interval_cur = l->adv_interval;
+    scan_duration = l->scan_duration;
+    adv_duration = l->adv_duration;
+    adv_events = l->adv_events;
+    lead_duration = l->lead_duration;
+    lead_events = l->lead_events;
+    adv_phase = l->adv_phase;
+
+    epoch_ticks = k_ms_to_ticks_ceil64(epoch_period);
+    adv_start_ticks = k_ms_to_ticks_ceil64(adv_phase);
+}
+
+/**
+ * @brief Switches to the parameters requested by blend_retune, if any
+ *
+ * Called at an epoch boundary, before the first phase of the new epoch is started.
+ */
+static void blend_retune_apply(void)
+{
+    struct blend_layout l;
+
+    if (!atomic_cas(&retune_pending, 1, 0)) {
+        return;
+    }
+    l = retune_layout;
+    blend_layout_apply(&l);
+    // a sync plan computed for the old layout no longer applies
+    sync_plan.valid = false;
+    timing_stats.retunes++;
+    LOG_INF("BLEnd retuned: epoch_period %d ms, adv_interval %d, scan_duration %d ms",
+            epoch_period, adv_interval_cur, scan_duration);
+}
+
+/**
+ * @brief Initializes the BLEnd module
+ *
+ * In U-BLEnd mode every epoch is a scan followed by beacons until just past E/2, so of two nodes
+ * at least one hears the other in every epoch. In B-BLEnd mode a node beacons for the whole epoch
+ * outside its scan, so both hear each other in every epoch, see blend_layout_compute.
+ *
+ * The scan and advertising windows are laid out for the airtime of the radio profile chosen
+ * with blend_phy_set, LE 1M legacy advertising by default.
+ *
+ * @param epoch_duration Duration of the epoch in milliseconds
+ * @param adv_interval Advertising interval in 0.625 milliseconds
+ * @param mode Discovery mode, U-BLEnd or B-BLEnd
+ *
+ * @retval 0 If the parameters were accepted.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int blend_init(int epoch_duration, int adv_interval, enum blend_mode mode)
+{
+    struct blend_layout l;
+    int err;
+
+    if (mode != BLEND_MODE_UNIDIRECTIONAL && mode != BLEND_MODE_BIDIRECTIONAL) {
+        LOG_ERR("Unknown BLEnd mode %d", mode);
+        return -EINVAL;
+    }
+    margins.airtime_us = adv_event_airtime_us(phy_req, channels_req);
+    err = blend_layout_compute(epoch_duration, adv_interval, mode, &l);
+    if (err) {
+        return err;
+    }
+    if (!blend_workq_started) {
+        k_work_queue_start(&blend_workq, blend_workq_stack, K_THREAD_STACK_SIZEOF(blend_workq_stack),
+                           K_PRIO_COOP(CONFIG_BLEND_WORKQ_PRIORITY), &blend_workq_config);
+        blend_workq_started = true;
+    }
+    blend_mode = mode;
+    blend_layout_apply(&l);
+    atomic_set(&retune_pending, 0);
+    if (IS_ENABLED(CONFIG_BLEND_SYNC)) {
+        size_t count = 1;
+
+        // the sync leader is the node with the lowest address
+        bt_id_get(&own_addr, &count);
+        if (count == 0) {
+            LOG_ERR("No identity address for group sync");
+            return -EINVAL;
+        }
+    }
+    LOG_INF("BLEnd init (%s, %u us per beacon): epoch_period %d ms, lead %d events, adv %d events (<= %d ms), scan_duration %d ms",
+            mode == BLEND_MODE_BIDIRECTIONAL ? "B-BLEnd" : "U-BLEnd", margins.airtime_us,
+            epoch_period, lead_events, adv_events, adv_duration, scan_duration);
+    return 0;
+}
+
+/**
+ * @brief Requests new BLEnd parameters
+ *
+ * The parameters are checked now and take effect at the next epoch boundary, so the epoch
+ * that is running keeps its layout. A later request replaces one that is still pending.
+ *
+ * @param epoch_duration Duration of the epoch in milliseconds
+ * @param adv_interval Advertising interval in 0.625 milliseconds
+ *
+ * @retval 0 If the parameters were accepted.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int blend_retune(int epoch_duration, int adv_interval)
+{
+    struct blend_layout l;
+    unsigned int key;
+    int err;
+
+    err = blend_layout_compute(epoch_duration, adv_interval, blend_mode, &l);
+    if (err) {
+        return err;
+    }
+    key = irq_lock();
+    retune_layout = l;
+    irq_unlock(key);
+    atomic_set(&retune_pending, 1);
+    return 0;
+}
+
+/**
+ * @brief Replaces the radio slack of the epoch layout
+ *
+ * The current or pending parameters are laid out again with the new margins and the result
+ * takes effect at the next epoch boundary, like a retune. Intended for margins measured at run
+ * time, see blend_calib.c.
+ *
+ * @param m New margins
+ *
+ * @retval 0 If the margins were accepted.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int blend_margins_set(const struct blend_margins *m)
+{
+    struct blend_margins old = margins;
+    int epoch_duration, adv_interval;
+    unsigned int key;
+    int err;
+
+    if (m->adv_delay_max_us > BLEND_ADV_DELAY_MAX_US || m->adv_delay_mean_us > m->adv_delay_max_us ||
+        m->airtime_us == 0) {
+        LOG_ERR("Invalid BLEnd margins");
+        return -EINVAL;
+    }
+    key = irq_lock();
+    if (atomic_get(&retune_pending)) {
+        epoch_duration = retune_layout.epoch_period;
+        adv_interval = retune_layout.adv_interval;
+    } else {
+        epoch_duration = epoch_period;
+        adv_interval = adv_interval_cur;
+    }
+    irq_unlock(key);
+
+    margins = *m;
+    err = blend_retune(epoch_duration, adv_interval);
+    if (err) {
+        margins = old;
+        return err;
+    }
+    LOG_INF("BLEnd margins: adv delay <= %u us (mean %u us), airtime %u us", m->adv_delay_max_us,
+            m->adv_delay_mean_us, m->airtime_us);
+    return 0;
+}
+
+/**
+ * @brief Selects the radio profile of the beacons
+ *
+ * Before blend_init the profile is only recorded. Once BLEnd is initialized, the current or
+ * pending parameters are laid out again for the airtime of the new profile, and the profile
+ * takes effect at the next epoch boundary. Nodes only hear each other on a common profile.
+ *
+ * @param phy Radio profile
+ *
+ * @retval 0 If the profile was accepted.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int blend_phy_set(enum blend_phy phy)
+{
+    struct blend_margins m = margins;
+    enum blend_phy old = phy_req;
+    int err;
+
+    if (phy != BLEND_PHY_1M && phy != BLEND_PHY_2M && phy != BLEND_PHY_CODED) {
+        LOG_ERR("Unknown BLEnd PHY profile %d", phy);
+        return -EINVAL;
+    }
+    phy_req = phy;
+    if (!blend_workq_started) {
+        return 0;
+    }
+    m.airtime_us = adv_event_airtime_us(phy, channels_req);
+    err = blend_margins_set(&m);
+    if (err) {
+        phy_req = old;
+    }
+    return err;
+}
+
+/**
+ * @brief Selects the primary channels the beacons are sent on
+ *
+ * Fewer channels shorten every advertising event and the time it can collide with the events of
+ * other nodes, at the price of a longer scan that visits the channels one after the other.
+ * Takes effect like blend_phy_set. Nodes only hear each other if their channel maps overlap.
+ *
+ * @param channels Mask of BLEND_CHAN_37, BLEND_CHAN_38 and BLEND_CHAN_39
+ *
+ * @retval 0 If the channel map was accepted.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int blend_channels_set(uint8_t channels)
+{
+    struct blend_margins m = margins;
+    uint8_t old = channels_req;
+    int err;
+
+    if (channels == 0 || (channels & ~BLEND_CHAN_ALL)) {
+        LOG_ERR("Invalid BLEnd channel map 0x%02x", channels);
+        return -EINVAL;
+    }
+    channels_req = channels;
+    if (!blend_workq_started) {
+        return 0;
+    }
+    m.airtime_us = adv_event_airtime_us(phy_req, channels);
+    err = blend_margins_set(&m);
+    if (err) {
+        channels_req = old;
+    }
+    return err;
+}
+
+/**
+ * @brief Copies the radio slack the epoch layout is computed with
+ *
+ * @param m Destination for the margins
+ */
+void blend_margins_get(struct blend_margins *m)
+{
+    *m = margins;
 }
 
 /**
  * @brief Starts the BLEnd module
  *
- * This function starts the epoch timer, which triggers the start of the BLEnd process.
+ * This function anchors the epoch grid at the current time and starts the first epoch.
  */
 void blend_start(void)
 {
-    k_timer_start(&epoch_timer, K_NO_WAIT, K_MSEC(epoch_period));
+    k_timer_stop(&blend_timer);
+    epoch_start = k_uptime_ticks();
+    deadline = epoch_start;
+    // a plan computed for the old grid no longer applies
+    sync_plan.valid = false;
+    if (IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+        blend_energy_epoch(epoch_count);
+    }
+    blend_enter_epoch();
     LOG_INF("BLEnd start");
 }
+
+/**
+ * @brief Stops the BLEnd module
+ *
+ * This function stops the state machine and any ongoing advertising or scanning processes.
+ */
+void blend_stop(void)
+{
+    k_timer_stop(&blend_timer);
+    state = BLEND_STATE_STOPPED;
+    if (IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+        blend_energy_stop();
+    }
+    k_work_submit_to_queue(&blend_workq, &adv_stop);
+    k_work_submit_to_queue(&blend_workq, &scan_stop);
+    LOG_INF("BLEnd stop");
+}
+
+/**
+ * @brief Returns the current epoch number
+ *
+ * The number counts the epochs BLEnd has run since boot, including the ones it skipped because
+ * the timer fell behind. It does not advance while BLEnd is stopped, and blend_start() continues
+ * from it.
+ */
+uint32_t blend_epoch_get(void)
+{
+    return epoch_count;
+}
+
+/**
+ * @brief Copies the timing statistics of the state machine
+ *
+ * @param stats Destination for the statistics
+ */
+void blend_timing_get(struct blend_timing_stats *stats)
+{
+    unsigned int key = irq_lock();
+
+    *stats = timing_stats;
+    irq_unlock(key);
+}
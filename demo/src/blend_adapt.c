@@ -0,0 +1,137 @@
+#include "blend_adapt.h"
+#include "blend.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(BLEnd_NONCONN_ADAPT, LOG_LEVEL_INF);
+
+/* Adaptive E/A controller
+    * Every epoch report gives the neighbors heard and the ones of the previous report that were
+    * not. Both are smoothed: the density counts the neighbors heard in either of the two epochs
+    * and the miss rate is the share of the previous report not heard again. The optimizer is
+    * rerun for a new density when the smoothed density leaves a hysteresis band around the
+    * density the current parameters were chosen for, or when misses exceed what the collision
+    * model predicts for it, which means more nodes are interfering than are counted. Retunes
+    * are at least CONFIG_BLEND_ADAPT_HOLD_EPOCHS apart so the layout does not flap.
+*/
+#define ADAPT_EWMA_SHIFT 2	// weight 1/4 for every new epoch
+
+static struct blend_adapt_config cfg;
+static struct blend_adapt_stats stats;
+static uint32_t density_ewma;	// in 1/16 neighbor
+static uint32_t miss_ewma;	// in 1/1000
+static uint32_t hold;
+static uint32_t prev_heard;
+static bool running;
+
+/**
+ * @brief Whether the smoothed miss rate is above what the model predicts for a density
+ *
+ * @param neighbors Density to compare against, with the current parameters
+ */
+static bool blend_adapt_excess_misses(uint16_t neighbors)
+{
+	// per-epoch discovery probability the model gives the current parameters
+	float p = blend_opt_probability(stats.epoch_ms, stats.adv_interval, cfg.target.bidirectional,
+					neighbors, stats.epoch_ms, &cfg.target.radio);
+	uint32_t expected_miss = (uint32_t)((1.0f - p) * 1000);
+
+	return miss_ewma > expected_miss + CONFIG_BLEND_ADAPT_MISS_MARGIN_PERMILLE;
+}
+
+// half-width of the hysteresis band around the planned density
+static uint16_t blend_adapt_band(void)
+{
+	return MAX(1, stats.neighbors * CONFIG_BLEND_ADAPT_HYSTERESIS_PCT / 100);
+}
+
+void blend_adapt_init(const struct blend_adapt_config *config,
+		      const struct blend_opt_result *initial, uint16_t neighbors)
+{
+	cfg = *config;
+	stats = (struct blend_adapt_stats){
+		.neighbors = neighbors,
+		.epoch_ms = initial->epoch_ms,
+		.adv_interval = initial->adv_interval,
+	};
+	density_ewma = neighbors * 16;
+	miss_ewma = 0;
+	hold = 0;
+	prev_heard = 0;
+	running = true;
+}
+
+/**
+ * @brief Picks parameters for a density and requests them
+ *
+ * @param neighbors Density to plan for
+ */
+static void blend_adapt_retune(uint16_t neighbors)
+{
+	struct blend_opt_target target = cfg.target;
+	struct blend_opt_result result;
+	int err;
+
+	target.neighbors = neighbors;
+	err = blend_opt_solve(&target, &result);
+	if (err || result.duty_cycle > cfg.max_duty_cycle) {
+		stats.rejected++;
+		LOG_WRN("No parameters for %u neighbors within the bounds (err %d)", neighbors, err);
+		return;
+	}
+	hold = 0;
+	stats.neighbors = neighbors;
+	if (result.epoch_ms == stats.epoch_ms && result.adv_interval == stats.adv_interval) {
+		return;
+	}
+	err = blend_retune(result.epoch_ms, result.adv_interval);
+	if (err) {
+		stats.rejected++;
+		return;
+	}
+	stats.retunes++;
+	stats.epoch_ms = result.epoch_ms;
+	stats.adv_interval = result.adv_interval;
+	LOG_INF("Retune for %u neighbors: E %u ms, A %u, duty cycle %d.%02d %%", neighbors,
+		result.epoch_ms, result.adv_interval, (int)(result.duty_cycle * 100),
+		(int)(result.duty_cycle * 10000) % 100);
+}
+
+void blend_adapt_report(const struct neighbor_report *report)
+{
+	// a neighbor of the last report that is missing from this one was missed
+	uint32_t tracked = report->heard + report->removed_count;
+	uint32_t miss = prev_heard ? MIN(report->removed_count, prev_heard) * 1000 / prev_heard : 0;
+	uint16_t density, neighbors;
+
+	prev_heard = report->heard;
+	if (!running) {
+		return;
+	}
+	density_ewma += ((int32_t)(tracked * 16) - (int32_t)density_ewma) >> ADAPT_EWMA_SHIFT;
+	miss_ewma += ((int32_t)miss - (int32_t)miss_ewma) >> ADAPT_EWMA_SHIFT;
+	stats.density_x16 = density_ewma;
+	stats.miss_permille = miss_ewma;
+	if (++hold < CONFIG_BLEND_ADAPT_HOLD_EPOCHS) {
+		return;
+	}
+
+	density = MAX(1, (density_ewma + 8) / 16);
+	neighbors = density;
+	if (blend_adapt_excess_misses(stats.neighbors)) {
+		// more collisions than the counted nodes explain: plan for a denser neighborhood
+		neighbors = MAX(density, stats.neighbors + stats.neighbors / 4 + 1);
+	} else if (density + blend_adapt_band() > stats.neighbors &&
+		   density < stats.neighbors + blend_adapt_band()) {
+		return;
+	} else if (density < stats.neighbors && blend_adapt_excess_misses(density)) {
+		// the misses would already be too many for the lower density
+		return;
+	}
+	blend_adapt_retune(neighbors);
+}
+
+void blend_adapt_stats_get(struct blend_adapt_stats *out)
+{
+	*out = stats;
+}
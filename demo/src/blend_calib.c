@@ -0,0 +1,151 @@
+#include "blend_calib.h"
+#include "blend.h"
+#include "beacon_tlv.h"
+#include "advertiser_scanner.h"
+
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+
+LOG_MODULE_REGISTER(BLEnd_NONCONN_CALIB, LOG_LEVEL_INF);
+
+/* Scan-slack calibration
+    * The scan window is one advertising interval plus the random advertising delay and the
+    * airtime of one event. The airtime follows from the radio profile; the delay is measured
+    * from the beacons we receive. The scanner stays on one channel for a whole window, so two
+    * beacons of the same neighbor heard one interval apart arrive exactly A + advDelay apart,
+    * with A the interval the neighbor publishes as BEACON_TLV_ADV_INTERVAL.
+    * Such a pair only fits in the window if its first beacon arrives early enough, which is less
+    * likely the longer the delay, so each sample is weighted by the inverse of that chance. The
+    * delay is drawn uniformly, so twice the weighted mean bounds it as well as the longest sample.
+    * Arrivals are stamped in the scan callback, so the guard also covers the jitter of the receive
+    * path. The observed delay only ever widens the margins after they are first applied.
+*/
+#define CALIB_SLOTS 16	// recent senders, indexed by the last address byte
+#define CALIB_WEIGHT_SCALE (1U << 24)
+#define CALIB_ROOM_MIN_US 500	// bounds the weight of pairs that only just fit in the window
+
+BUILD_ASSERT((CALIB_SLOTS & (CALIB_SLOTS - 1)) == 0, "CALIB_SLOTS must be a power of two");
+BUILD_ASSERT(sizeof(uint16_t) + BEACON_TLV_OVERHEAD <= ADV_APP_DATA_MAX,
+	     "CONFIG_BLEND_BEACON_DATA_MAX has no room for the advertising interval");
+
+struct calib_slot {
+	bt_addr_le_t addr;
+	uint32_t cyc;
+};
+
+static struct calib_slot slots[CALIB_SLOTS];
+static struct blend_calib_stats stats;
+/* weighted sums of the samples, see blend_calib_beacon */
+static uint64_t weight_sum;
+static uint64_t delay_sum;
+/* largest delay the applied margins were computed from */
+static uint32_t applied_max_us;
+
+static void blend_calib_handler(struct k_work *work);
+
+/**
+ * @brief Longest delay the samples so far call for, with interrupts locked
+ */
+static uint32_t blend_calib_delay_max(void)
+{
+	return MAX(stats.delay_max_us, MIN(2 * stats.delay_mean_us, BLEND_ADV_DELAY_MAX_US));
+}
+
+K_WORK_DEFINE(calib_work, blend_calib_handler);
+
+/**
+ * @brief Hands the measured delay to BLEnd
+ *
+ * @param *work Work item of the calibration
+ */
+static void blend_calib_handler(struct k_work *work)
+{
+	struct blend_margins m;
+	uint32_t delay_max, delay_mean;
+	unsigned int key;
+
+	key = irq_lock();
+	delay_max = blend_calib_delay_max();
+	delay_mean = stats.delay_mean_us;
+	irq_unlock(key);
+
+	blend_margins_get(&m);
+	m.adv_delay_max_us = MIN(delay_max + CONFIG_BLEND_CALIB_GUARD_US, BLEND_ADV_DELAY_MAX_US);
+	m.adv_delay_mean_us = MIN(delay_mean, m.adv_delay_max_us);
+	if (blend_margins_set(&m)) {
+		return;
+	}
+	applied_max_us = delay_max;
+	stats.applied++;
+}
+
+int blend_calib_publish(uint16_t adv_interval)
+{
+	uint8_t value[sizeof(uint16_t)];
+
+	sys_put_le16(adv_interval, value);
+	return beacon_tlv_set(BEACON_TLV_ADV_INTERVAL, value, sizeof(value));
+}
+
+void blend_calib_beacon(const bt_addr_le_t *addr, uint32_t cyc, const uint8_t *data, size_t len,
+			uint32_t window_us)
+{
+	struct calib_slot *slot = &slots[addr->a.val[0] & (CALIB_SLOTS - 1)];
+	struct blend_margins m;
+	const uint8_t *value;
+	int32_t interval_us, gap_us, delay_us, room_us;
+	uint32_t weight, delay_max;
+	unsigned int key;
+
+	if (!bt_addr_le_eq(&slot->addr, addr)) {
+		bt_addr_le_copy(&slot->addr, addr);
+		slot->cyc = cyc;
+		return;
+	}
+	gap_us = k_cyc_to_us_floor32(cyc - slot->cyc);
+	slot->cyc = cyc;
+	if (beacon_tlv_get(data, len, BEACON_TLV_ADV_INTERVAL, &value) != sizeof(uint16_t)) {
+		// the sender does not calibrate, so its interval is unknown
+		return;
+	}
+	interval_us = sys_get_le16(value) * 625;
+	delay_us = gap_us - interval_us;
+	if (delay_us >= interval_us) {
+		// not consecutive beacons: another window, or beacons lost in between
+		return;
+	}
+	// a pair fits in the window if its first beacon is at most this far into it
+	blend_margins_get(&m);
+	room_us = MAX((int32_t)window_us - gap_us - (int32_t)m.airtime_us, CALIB_ROOM_MIN_US);
+	weight = CALIB_WEIGHT_SCALE / room_us;
+
+	key = irq_lock();
+	if (delay_us < -CONFIG_BLEND_CALIB_GUARD_US ||
+	    delay_us > BLEND_ADV_DELAY_MAX_US + CONFIG_BLEND_CALIB_GUARD_US) {
+		// a late report, or an interval changed since the beacon was built
+		stats.rejected++;
+		irq_unlock(key);
+		return;
+	}
+	delay_us = CLAMP(delay_us, 0, BLEND_ADV_DELAY_MAX_US);
+	stats.samples++;
+	weight_sum += weight;
+	delay_sum += (uint64_t)weight * delay_us;
+	stats.delay_mean_us = delay_sum / weight_sum;
+	stats.delay_max_us = MAX(stats.delay_max_us, delay_us);
+	delay_max = blend_calib_delay_max();
+	irq_unlock(key);
+
+	if (stats.samples >= CONFIG_BLEND_CALIB_MIN_SAMPLES &&
+	    (stats.applied == 0 || delay_max > applied_max_us + CONFIG_BLEND_CALIB_GUARD_US / 2)) {
+		k_work_submit(&calib_work);
+	}
+}
+
+void blend_calib_stats_get(struct blend_calib_stats *out)
+{
+	unsigned int key = irq_lock();
+
+	*out = stats;
+	irq_unlock(key);
+}
@@ -0,0 +1,68 @@
+#ifndef BLEND_ENERGY_NONCONN
+#define BLEND_ENERGY_NONCONN
+
+#include <zephyr/kernel.h>
+
+/** @brief What the radio did in one epoch. */
+struct blend_energy_epoch {
+	uint32_t epoch;            /**< Number of the epoch. */
+	uint32_t duration_us;      /**< Measured length, shorter if BLEnd was stopped in it. */
+	uint32_t scan_us;          /**< Time a scan window was open. */
+	uint32_t adv_us;           /**< Time an advertising window was open. */
+	uint32_t idle_us;          /**< Time neither window was open. */
+	uint32_t beacons_sent;     /**< Advertising events the controller reported sent. */
+	uint32_t packets_received; /**< Beacons that passed the scan filter. */
+	uint32_t charge_nc;        /**< Charge under the current model, in nanocoulombs. */
+};
+
+/** @brief Energy accounting since boot or the last reset. */
+struct blend_energy_stats {
+	struct blend_energy_epoch last; /**< The most recent epoch that ended. */
+	uint32_t epochs;                /**< Epochs accounted. */
+	uint64_t duration_us;           /**< Sums over those epochs. */
+	uint64_t scan_us;
+	uint64_t adv_us;
+	uint64_t idle_us;
+	uint64_t beacons_sent;
+	uint64_t packets_received;
+	uint64_t charge_nc;
+	uint32_t avg_current_na;        /**< Mean current under the model. */
+	uint32_t battery_life_h;        /**< CONFIG_BLEND_ENERGY_BATTERY_MAH at that current. */
+};
+
+/* Radio events, for CONFIG_BLEND_ENERGY. Time is taken from k_uptime_ticks() on each call. */
+
+/** @brief An epoch starts: the one before it, if any, is accounted.
+ *
+ * @param[in] epoch Number of the epoch that starts.
+ */
+void blend_energy_epoch(uint32_t epoch);
+
+/** @brief BLEnd stops: the running epoch is accounted as it is. */
+void blend_energy_stop(void);
+
+/** @brief A scan window opens. */
+void blend_energy_scan_on(void);
+
+/** @brief A scan window closes. */
+void blend_energy_scan_off(void);
+
+/** @brief An advertising window opens. */
+void blend_energy_adv_on(void);
+
+/** @brief An advertising window closes.
+ *
+ * @param[in] sent Advertising events the controller sent in it, 0 if it was stopped early.
+ */
+void blend_energy_adv_off(uint16_t sent);
+
+/** @brief A beacon passed the scan filter. */
+void blend_energy_rx(void);
+
+/** @brief Copy the accounting, with the mean current and battery life under the model. */
+void blend_energy_get(struct blend_energy_stats *stats);
+
+/** @brief Clear the accounting; the running epoch counts from now. */
+void blend_energy_reset(void);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef BLEND_GROUP_NONCONN
+#define BLEND_GROUP_NONCONN
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+
+/* Group data channel
+ *
+ * With CONFIG_BLEND_GROUP one node, the source, runs a periodic advertising train on its BLEnd
+ * advertising set, and its beacons carry the sync info of the train. Every neighbor that hears a
+ * beacon syncs to the train and receives the group data without a connection, so the cost of
+ * the source does not grow with the group. A node follows one train at a time.
+ */
+
+/** @brief Callback type for data received on the group channel.
+ *
+ * Runs in the Bluetooth RX context. The data is only valid during the call.
+ */
+typedef void (*blend_group_recv_cb_t)(const bt_addr_le_t *source, const uint8_t *data, size_t len,
+				      void *user_data);
+
+/** @brief Start feeding the group channel.
+ *
+ * Starts a periodic advertising train of CONFIG_BLEND_GROUP_INTERVAL_MS on the BLEnd advertising
+ * set, with no data yet. Call after blend_init(). Thread context only.
+ *
+ * @retval 0 If the train is running.
+ * @retval -ENOTSUP If the advertising set is connectable, as in demo_connect.
+ */
+int blend_group_source_start(void);
+
+/** @brief Stop feeding the group channel. */
+int blend_group_source_stop(void);
+
+/** @brief Publish data on the group channel.
+ *
+ * Synced neighbors receive it from the next periodic advertising event on, until it is replaced.
+ * Thread context only.
+ *
+ * @param[in] data Data, copied.
+ * @param[in] len Length of the data.
+ *
+ * @retval 0 If the data was handed to the controller.
+ * @retval -EMSGSIZE If len exceeds CONFIG_BLEND_GROUP_DATA_MAX.
+ */
+int blend_group_send(const void *data, size_t len);
+
+/** @brief Register the callback for data received on the group channel.
+ *
+ * @param[in] cb Callback function, NULL to stop.
+ * @param[in] user_data Passed to the callback.
+ */
+void blend_group_recv_cb_register(blend_group_recv_cb_t cb, void *user_data);
+
+/** @brief Hand a beacon carrying sync info to the group channel.
+ *
+ * Called from the scan callback with CONFIG_BLEND_GROUP for every beacon with a periodic
+ * advertising interval. Starts syncing to the train unless the node follows or feeds one.
+ *
+ * @param[in] info Receive information of the beacon.
+ */
+void blend_group_beacon(const struct bt_le_scan_recv_info *info);
+
+/** @brief Source of the train the node follows.
+ *
+ * @param[out] source Address of the source.
+ *
+ * @retval 0 If the node is synced.
+ * @retval -ENOTCONN If it is not.
+ */
+int blend_group_source_get(bt_addr_le_t *source);
+
+#endif
@@ -0,0 +1,204 @@
+#include "blend_jitter.h"
+
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(BLEnd_NONCONN_JITTER, LOG_LEVEL_INF);
+
+/* Epoch-timing jitter benchmark
+    * Every transition is stamped with the cycle counter and sorted into a histogram of
+    * CONFIG_BLEND_JITTER_BINS bins of CONFIG_BLEND_JITTER_BIN_US, so the p99 over any number of
+    * epochs costs a fixed amount of memory. The grid drift accumulates 32-bit cycle differences
+    * from one epoch start to the next, so it survives wraps of the cycle counter as long as an
+    * epoch is shorter than one wrap.
+*/
+struct jitter_point {
+	struct blend_jitter_stats stats;
+	uint32_t bins[CONFIG_BLEND_JITTER_BINS];
+};
+
+static const char *const point_names[BLEND_JITTER_POINTS] = {
+	[BLEND_JITTER_EPOCH] = "epoch",
+	[BLEND_JITTER_PHASE] = "phase",
+	[BLEND_JITTER_WORK] = "work",
+	[BLEND_JITTER_SCAN_END] = "scan end",
+};
+
+static struct jitter_point points[BLEND_JITTER_POINTS];
+static uint32_t epochs;
+static bool drift_started;
+/* first epoch start, and the stamp of the last one */
+static k_ticks_t first_deadline;
+static uint32_t last_cyc;
+static int64_t elapsed_cyc;
+static int32_t drift_us, drift_min_us, drift_max_us;
+
+static void blend_jitter_report_handler(struct k_work *work);
+
+K_WORK_DEFINE(jitter_report_work, blend_jitter_report_handler);
+
+/**
+ * @brief Adds one sample, with interrupts locked
+ *
+ * @param point Transition the sample is for
+ * @param late_cyc Lateness in cycles
+ */
+static void jitter_add(enum blend_jitter_point point, int32_t late_cyc)
+{
+	struct jitter_point *p = &points[point];
+	uint32_t late_us = k_cyc_to_us_floor32(late_cyc > 0 ? late_cyc : 0);
+	uint32_t bin = late_us / CONFIG_BLEND_JITTER_BIN_US;
+
+	p->stats.count++;
+	p->stats.sum_us += late_us;
+	p->stats.max_us = MAX(p->stats.max_us, late_us);
+	p->stats.min_us = p->stats.count == 1 ? late_us : MIN(p->stats.min_us, late_us);
+	if (bin < CONFIG_BLEND_JITTER_BINS) {
+		p->bins[bin]++;
+	} else {
+		p->stats.overflow++;
+	}
+}
+
+/**
+ * @brief Updates the grid drift at an epoch start, with interrupts locked
+ *
+ * @param cyc Cycle count on entry to the timer handler
+ * @param deadline Deadline of the epoch start in ticks
+ */
+static void jitter_drift(uint32_t cyc, k_ticks_t deadline)
+{
+	int64_t drift_cyc;
+
+	if (!drift_started) {
+		drift_started = true;
+		first_deadline = deadline;
+		last_cyc = cyc;
+		elapsed_cyc = 0;
+		return;
+	}
+	elapsed_cyc += (uint32_t)(cyc - last_cyc);
+	last_cyc = cyc;
+	epochs++;
+	drift_cyc = elapsed_cyc - (int64_t)k_ticks_to_cyc_floor64(deadline - first_deadline);
+	drift_us = (int32_t)(drift_cyc * USEC_PER_SEC / sys_clock_hw_cycles_per_sec());
+	drift_min_us = epochs == 1 ? drift_us : MIN(drift_min_us, drift_us);
+	drift_max_us = epochs == 1 ? drift_us : MAX(drift_max_us, drift_us);
+}
+
+/**
+ * @brief Records a timer transition of the state machine
+ *
+ * @param epoch_boundary true when the transition starts an epoch
+ * @param cyc Cycle count on entry to the timer handler
+ * @param deadline Absolute tick deadline the timer was armed for
+ */
+void blend_jitter_transition(bool epoch_boundary, uint32_t cyc, k_ticks_t deadline)
+{
+	int32_t late_cyc = (int32_t)(cyc - (uint32_t)k_ticks_to_cyc_floor64(deadline));
+	unsigned int key = irq_lock();
+
+	jitter_add(epoch_boundary ? BLEND_JITTER_EPOCH : BLEND_JITTER_PHASE, late_cyc);
+	if (epoch_boundary) {
+		jitter_drift(cyc, deadline);
+	}
+	irq_unlock(key);
+
+	if (epoch_boundary && epochs > 0 && epochs % CONFIG_BLEND_JITTER_REPORT_EPOCHS == 0) {
+		k_work_submit(&jitter_report_work);
+	}
+}
+
+/**
+ * @brief Records the lateness of a work item or of the scan end
+ *
+ * @param point Transition the sample is for
+ * @param late_cyc Lateness in cycles
+ */
+void blend_jitter_record(enum blend_jitter_point point, int32_t late_cyc)
+{
+	unsigned int key = irq_lock();
+
+	jitter_add(point, late_cyc);
+	irq_unlock(key);
+}
+
+/**
+ * @brief Returns the 99th percentile of a transition from its histogram
+ *
+ * @param p Transition, with interrupts locked
+ */
+static uint32_t jitter_p99(const struct jitter_point *p)
+{
+	uint32_t rank = DIV_ROUND_UP((uint64_t)p->stats.count * 99, 100);
+	uint32_t seen = 0;
+
+	for (uint32_t i = 0; i < CONFIG_BLEND_JITTER_BINS; i++) {
+		seen += p->bins[i];
+		if (seen >= rank) {
+			return MIN((i + 1) * CONFIG_BLEND_JITTER_BIN_US - 1, p->stats.max_us);
+		}
+	}
+	return p->stats.max_us;
+}
+
+/**
+ * @brief Copies the benchmark results
+ *
+ * @param report Destination for the results
+ */
+void blend_jitter_get(struct blend_jitter_report *report)
+{
+	unsigned int key;
+
+	for (int i = 0; i < BLEND_JITTER_POINTS; i++) {
+		key = irq_lock();
+		report->points[i] = points[i].stats;
+		report->points[i].p99_us = jitter_p99(&points[i]);
+		irq_unlock(key);
+	}
+	key = irq_lock();
+	report->epochs = epochs;
+	report->drift_us = drift_us;
+	report->drift_min_us = drift_min_us;
+	report->drift_max_us = drift_max_us;
+	irq_unlock(key);
+}
+
+/**
+ * @brief Clears the benchmark results
+ */
+void blend_jitter_reset(void)
+{
+	unsigned int key = irq_lock();
+
+	memset(points, 0, sizeof(points));
+	epochs = 0;
+	drift_started = false;
+	drift_us = drift_min_us = drift_max_us = 0;
+	irq_unlock(key);
+}
+
+/**
+ * @brief Logs the benchmark results every CONFIG_BLEND_JITTER_REPORT_EPOCHS epochs
+ *
+ * @param *work Work item of the report
+ */
+static void blend_jitter_report_handler(struct k_work *work)
+{
+	static struct blend_jitter_report report;
+
+	blend_jitter_get(&report);
+	LOG_INF("jitter after %u epochs, lateness in us:", report.epochs);
+	for (int i = 0; i < BLEND_JITTER_POINTS; i++) {
+		const struct blend_jitter_stats *s = &report.points[i];
+
+		if (s->count == 0) {
+			continue;
+		}
+		LOG_INF("  %-8s n %u min %u mean %u p99 %u max %u", point_names[i], s->count, s->min_us,
+			(uint32_t)(s->sum_us / s->count), s->p99_us, s->max_us);
+	}
+	LOG_INF("  drift %d us, range %d to %d us", report.drift_us, report.drift_min_us,
+		report.drift_max_us);
+}
@@ -0,0 +1,60 @@
+#ifndef BLEND_JITTER_NONCONN
+#define BLEND_JITTER_NONCONN
+
+#include <zephyr/kernel.h>
+
+/** @brief Transitions the jitter benchmark times. */
+enum blend_jitter_point {
+	BLEND_JITTER_EPOCH,    /**< Epoch start, from its deadline to the timer handler. */
+	BLEND_JITTER_PHASE,    /**< Any other timer transition, from its deadline to the handler. */
+	BLEND_JITTER_WORK,     /**< Radio work item, from its submission to the handler. */
+	BLEND_JITTER_SCAN_END, /**< Scan timeout callback, from the nominal end of the scan window. */
+	BLEND_JITTER_POINTS,
+};
+
+/** @brief Lateness distribution of one transition. */
+struct blend_jitter_stats {
+	uint32_t count;    /**< Samples recorded. */
+	uint32_t min_us;   /**< Smallest lateness. */
+	uint32_t p99_us;   /**< 99th percentile, rounded up to the histogram bin. */
+	uint32_t max_us;   /**< Largest lateness. */
+	uint64_t sum_us;   /**< Sum of all samples, for the mean. */
+	uint32_t overflow; /**< Samples beyond the histogram, p99 is the maximum if it falls there. */
+};
+
+/** @brief Jitter benchmark results. */
+struct blend_jitter_report {
+	struct blend_jitter_stats points[BLEND_JITTER_POINTS];
+	uint32_t epochs;       /**< Epoch starts timed since the first one. */
+	int32_t drift_us;      /**< Time since the first epoch start minus its nominal value. */
+	int32_t drift_min_us;  /**< Smallest drift seen at an epoch start. */
+	int32_t drift_max_us;  /**< Largest drift seen at an epoch start. */
+};
+
+/** @brief Record a timer transition of the BLEnd state machine.
+ *
+ * Call from the timer handler with CONFIG_BLEND_JITTER. The deadline is converted to the cycle
+ * counter the kernel derives its ticks from, so the lateness has the resolution of a cycle.
+ * Epoch starts also update the drift of the grid: the cycles elapsed since the first epoch
+ * start, compared with the ticks between their deadlines.
+ *
+ * @param[in] epoch_boundary true when the transition starts an epoch.
+ * @param[in] cyc Cycle count on entry to the handler.
+ * @param[in] deadline Absolute tick deadline the timer was armed for.
+ */
+void blend_jitter_transition(bool epoch_boundary, uint32_t cyc, k_ticks_t deadline);
+
+/** @brief Record the lateness of another transition.
+ *
+ * @param[in] point BLEND_JITTER_WORK or BLEND_JITTER_SCAN_END.
+ * @param[in] late_cyc Lateness in cycles, clamped at 0.
+ */
+void blend_jitter_record(enum blend_jitter_point point, int32_t late_cyc);
+
+/** @brief Copy the benchmark results. */
+void blend_jitter_get(struct blend_jitter_report *report);
+
+/** @brief Clear the benchmark results; the next epoch start becomes the drift reference. */
+void blend_jitter_reset(void);
+
+#endif
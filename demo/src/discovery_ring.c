@@ -0,0 +1,72 @@
+#include "discovery_ring.h"
+
+#include <zephyr/sys/atomic.h>
+
+/* Discovery event ring
+    * A single-producer/single-consumer ring of fixed-size records. The producer only ever writes
+    * the tail and the consumer only ever writes the head, each with one atomic store after the
+    * record is copied, so neither side takes a lock or waits for the other. The indices run
+    * freely and are masked on access, so a full ring needs no spare slot.
+*/
+#define DISCOVERY_RING_SIZE CONFIG_BLEND_DISCOVERY_RING_SIZE
+#define DISCOVERY_RING_MASK (DISCOVERY_RING_SIZE - 1)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(DISCOVERY_RING_SIZE), "CONFIG_BLEND_DISCOVERY_RING_SIZE must be a power of two");
+
+static struct discovery_event ring[DISCOVERY_RING_SIZE];
+static atomic_t head;	// next slot to read, written by the consumer
+static atomic_t tail;	// next slot to write, written by the producer
+static atomic_t pushed, overflow, high_water;
+
+/* wakes the consumer; the count is capped at one, a pending event is all it needs to know */
+K_SEM_DEFINE(discovery_ring_sem, 0, 1);
+
+int discovery_ring_put(const struct discovery_event *event)
+{
+	atomic_val_t t = atomic_get(&tail);
+	uint32_t used = (uint32_t)(t - atomic_get(&head));
+
+	if (used >= DISCOVERY_RING_SIZE) {
+		atomic_inc(&overflow);
+		return -ENOBUFS;
+	}
+	ring[t & DISCOVERY_RING_MASK] = *event;
+	atomic_set(&tail, t + 1);
+
+	atomic_inc(&pushed);
+	if (used + 1 > (uint32_t)atomic_get(&high_water)) {
+		atomic_set(&high_water, used + 1);
+	}
+	k_sem_give(&discovery_ring_sem);
+	return 0;
+}
+
+int discovery_ring_get(struct discovery_event *event)
+{
+	atomic_val_t h = atomic_get(&head);
+
+	if (h == atomic_get(&tail)) {
+		return -EAGAIN;
+	}
+	*event = ring[h & DISCOVERY_RING_MASK];
+	atomic_set(&head, h + 1);
+	return 0;
+}
+
+int discovery_ring_wait(k_timeout_t timeout)
+{
+	while (atomic_get(&head) == atomic_get(&tail)) {
+		if (k_sem_take(&discovery_ring_sem, timeout) != 0) {
+			return -EAGAIN;
+		}
+	}
+	return 0;
+}
+
+void discovery_ring_stats_get(struct discovery_ring_stats *stats)
+{
+	stats->pushed = (uint32_t)atomic_get(&pushed);
+	stats->overflow = (uint32_t)atomic_get(&overflow);
+	stats->high_water = (uint32_t)atomic_get(&high_water);
+	stats->pending = (uint32_t)(atomic_get(&tail) - atomic_get(&head));
+}
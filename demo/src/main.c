@@ -8,6 +8,7 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 
 /*  Include the header file of the Bluetooth LE stack */
 #include <zephyr/bluetooth/bluetooth.h>
@@ -18,7 +19,12 @@
 
 #include <dk_buttons_and_leds.h>
 #include "blend.h"
+#include "blend_opt.h"
+#include "blend_adapt.h"
 #include "advertiser_scanner.h"
+#include "neighbor.h"
+#include "beacon_tlv.h"
+#include "blend_group.h"
 LOG_MODULE_REGISTER(BLEnd_NONCONN_MAIN, LOG_LEVEL_INF);
 
 
@@ -27,12 +33,83 @@ LOG_MODULE_REGISTER(BLEnd_NONCONN_MAIN, LOG_LEVEL_INF);
 /* Timer for BLEnd timming */
 #define EPOCH_DURATION 10000		// 10 seconds
 #define ADV_INTERVAL 800		// 0.625ms 500ms
+#define BLEND_MODE BLEND_MODE_UNIDIRECTIONAL	// or BLEND_MODE_BIDIRECTIONAL for B-BLEnd
+#define BLEND_PHY BLEND_PHY_1M	// BLEND_PHY_2M for shorter beacons, BLEND_PHY_CODED for range
+#define BLEND_CHANNELS BLEND_CHAN_ALL	// e.g. BLEND_CHAN_37 alone in dense deployments
+/* Discovery targets: E and A are picked by the BLEnd optimizer, the values above are the fallback */
+#define TARGET_LATENCY 30000		// 30 seconds
+#define TARGET_PROBABILITY 0.95f
+#define EXPECTED_NEIGHBORS 10
+/* E and A are retuned to the observed density, within this radio duty cycle */
+#define MAX_DUTY_CYCLE 0.10f
+/* Types of the values this demo publishes in its beacons */
+#define TLV_NEIGHBOR_COUNT 0x01
+/* With CONFIG_BLEND_GROUP, true on the one node that feeds the group channel */
+#define GROUP_SOURCE false
 
 
+/* Counts the neighbors whose heard-neighbors filter lists this node */
+static void count_mutual(const struct neighbor *neighbor, void *user_data)
+{
+	if (neighbor->hears_us == NEIGHBOR_HEARS_US_YES) {
+		(*(int *)user_data)++;
+	}
+}
+
+/* Called once per epoch with the neighbors that joined or left the set heard by this node */
+static void neighbor_report(const struct neighbor_report *report, void *user_data)
+{
+	uint8_t heard = MIN(report->heard, UINT8_MAX);
+	int err;
+
+	LOG_INF("epoch %u: %u neighbors, %u added, %u removed", report->epoch, report->heard,
+		report->added_count, report->removed_count);
+	if (IS_ENABLED(CONFIG_BLEND_HEARD_FILTER)) {
+		int mutual = 0;
+
+		neighbor_foreach(count_mutual, &mutual);
+		LOG_INF("%d neighbors have heard us back", mutual);
+	}
+	blend_adapt_report(report);
+	// publish the neighbor count in our beacons, without restarting advertising
+	err = beacon_tlv_set(TLV_NEIGHBOR_COUNT, &heard, sizeof(heard));
+	if (err) {
+		LOG_ERR("Neighbor count failed to publish (err %d)", err);
+	}
+	if (IS_ENABLED(CONFIG_BLEND_GROUP) && GROUP_SOURCE) {
+		// and the epoch and count of the source to the whole group, one train for all
+		uint8_t status[5];
+
+		sys_put_le32(report->epoch, status);
+		status[4] = heard;
+		(void)blend_group_send(status, sizeof(status));
+	}
+}
+
+/* Called with the status the source sends on the group channel */
+static void group_status(const bt_addr_le_t *source, const uint8_t *data, size_t len,
+			 void *user_data)
+{
+	if (len < 5) {
+		return;
+	}
+	LOG_INF("group: source at epoch %u with %u neighbors", sys_get_le32(data), data[4]);
+}
+
 int main(void)
 {
 	int blink_status = 0;
 	int err;
+	struct blend_opt_target target = {
+		.latency_ms = TARGET_LATENCY,
+		.probability = TARGET_PROBABILITY,
+		.neighbors = EXPECTED_NEIGHBORS,
+		.bidirectional = (BLEND_MODE == BLEND_MODE_BIDIRECTIONAL),
+	};
+	struct blend_opt_result params;
+	struct blend_adapt_config adapt_config;
+	struct discovery_event event;
+	int64_t next_blink;
 	
 	LOG_INF("Uni-direct BLEnd: non-connectable test \n");
     
@@ -53,11 +130,57 @@ int main(void)
 	LOG_INF("Bluetooth initialized\n");
     
 	
+	// the optimizer models the beacons of the chosen radio profile and channels
+	target.radio.beacon_us = adv_event_airtime_us(BLEND_PHY, BLEND_CHANNELS);
+	target.radio.channels = POPCOUNT(BLEND_CHANNELS);
+	err = blend_opt_solve(&target, &params);
+	if (err) {
+		LOG_WRN("No BLEnd parameters meet the target (err %d), using defaults\n", err);
+		params.epoch_ms = EPOCH_DURATION;
+		params.adv_interval = ADV_INTERVAL;
+	} else {
+		LOG_INF("BLEnd optimizer: duty cycle %d.%02d %%\n", (int)(params.duty_cycle * 100),
+			(int)(params.duty_cycle * 10000) % 100);
+	}
+
 	scan_init();
-	adv_init(ADV_INTERVAL);
+	adv_init(params.adv_interval);
     
-	blend_init(EPOCH_DURATION, ADV_INTERVAL);
+	err = blend_phy_set(BLEND_PHY);
+	if (err) {
+		LOG_ERR("BLEnd PHY profile not supported (err %d)\n", err);
+		return -1;
+	}
+	err = blend_channels_set(BLEND_CHANNELS);
+	if (err) {
+		LOG_ERR("BLEnd channel map not supported (err %d)\n", err);
+		return -1;
+	}
+	err = blend_init(params.epoch_ms, params.adv_interval, BLEND_MODE);
+	if (err && (params.epoch_ms != EPOCH_DURATION || params.adv_interval != ADV_INTERVAL)) {
+		LOG_WRN("BLEnd rejected the solved parameters (err %d), using defaults\n", err);
+		params.epoch_ms = EPOCH_DURATION;
+		params.adv_interval = ADV_INTERVAL;
+		err = blend_init(params.epoch_ms, params.adv_interval, BLEND_MODE);
+	}
+	if (err) {
+		LOG_ERR("BLEnd init failed (err %d)\n", err);
+		return -1;
+	}
+	adapt_config.target = target;
+	adapt_config.max_duty_cycle = MAX_DUTY_CYCLE;
+	blend_adapt_init(&adapt_config, &params, EXPECTED_NEIGHBORS);
+	neighbor_report_cb_register(neighbor_report, NULL);
 	blend_start();
+	if (IS_ENABLED(CONFIG_BLEND_GROUP)) {
+		blend_group_recv_cb_register(group_status, NULL);
+		if (GROUP_SOURCE) {
+			err = blend_group_source_start();
+			if (err) {
+				LOG_ERR("Group channel failed to start (err %d)\n", err);
+			}
+		}
+	}
 	
     
 
@@ -65,8 +188,18 @@ int main(void)
 
 	
 
+	// drain the discovery ring between blinks; only first sightings are logged
+	next_blink = k_uptime_get();
 	for (;;) {
-		dk_set_led(RUN_STATUS_LED, (++blink_status) % 2);
-		k_sleep(K_MSEC(RUN_LED_BLINK_INTERVAL));
+		while (discovery_ring_get(&event) == 0) {
+			if (event.is_new) {
+				scan_event_log(&event);
+			}
+		}
+		if (k_uptime_get() >= next_blink) {
+			dk_set_led(RUN_STATUS_LED, (++blink_status) % 2);
+			next_blink += RUN_LED_BLINK_INTERVAL;
+		}
+		(void)discovery_ring_wait(K_TIMEOUT_ABS_MS(next_blink));
 	}
 }
\ No newline at end of file
@@ -0,0 +1,171 @@
+#ifndef NEIGHBOR_NONCONN
+#define NEIGHBOR_NONCONN
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+
+/** @brief Schedule a neighbor carries in its beacons. */
+struct neighbor_beacon {
+	uint16_t epoch;     /**< Epoch counter of the sender, modulo 2^16. */
+	uint16_t epoch_ms;  /**< Epoch length of the sender in milliseconds. */
+	uint16_t phase_ms;  /**< Start of the advertising window within the sender's epoch. */
+	uint16_t window_ms; /**< Longest the advertising window can last. */
+};
+
+/** @brief Whether a neighbor has heard us, from the heard-neighbors filter in its beacons. */
+enum neighbor_hears_us {
+	NEIGHBOR_HEARS_US_UNKNOWN, /**< Its beacons carry no filter. */
+	NEIGHBOR_HEARS_US_NO,      /**< Its last filter does not list us. */
+	NEIGHBOR_HEARS_US_YES,     /**< Its last filter lists us. */
+};
+
+/** @brief A discovered BLEnd neighbor. */
+struct neighbor {
+	/** Address of the neighbor. */
+	bt_addr_le_t addr;
+	/** Uptime in milliseconds when the neighbor was first heard. */
+	int64_t first_seen;
+	/** Uptime in milliseconds when the neighbor was last heard. */
+	int64_t last_seen;
+	/** Number of distinct epochs in which the neighbor was heard. */
+	uint32_t epoch_count;
+	/** Last epoch in which the neighbor was heard. */
+	uint32_t last_epoch;
+	/** Exponentially weighted moving average of the RSSI, in 1/16 dBm. */
+	int16_t rssi_ewma;
+	/** Schedule from the last beacon, epoch_ms is 0 if the neighbor never sent one. */
+	struct neighbor_beacon schedule;
+	/** Earliest uptime in milliseconds the next advertising window can start. */
+	int64_t next_window_min;
+	/** Latest uptime in milliseconds the next advertising window can start. */
+	int64_t next_window_max;
+	/** Whether the neighbor has heard us, see heard_filter_mutual(). */
+	enum neighbor_hears_us hears_us;
+};
+
+/** @brief Neighbor table counters. */
+struct neighbor_table_stats {
+	uint32_t count;   /**< Neighbors currently in the table. */
+	uint32_t evicted; /**< Neighbors replaced because their probe window was full. */
+	uint32_t aged;    /**< Neighbors removed because they were silent for too long. */
+};
+
+/** @brief Neighbor-set report of one epoch, as changes against the previous report. */
+struct neighbor_report {
+	/** First epoch covered by the report. */
+	uint32_t epoch;
+	/** Number of epochs covered, more than one when the state machine skipped epochs. */
+	uint32_t epochs;
+	/** Number of neighbors heard in the covered epochs. */
+	uint16_t heard;
+	/** Number of entries in added. */
+	uint16_t added_count;
+	/** Number of entries in removed. */
+	uint16_t removed_count;
+	/** Neighbors heard now but not in the previous report. */
+	const bt_addr_le_t *added;
+	/** Neighbors in the previous report that were not heard now, aged out or evicted. */
+	const bt_addr_le_t *removed;
+};
+
+/** @brief Callback type for iterating over the neighbor table. */
+typedef void (*neighbor_cb_t)(const struct neighbor *neighbor, void *user_data);
+
+/** @brief Callback type for the per-epoch neighbor-set report.
+ *
+ * Runs on the system workqueue. The address arrays are only valid during the call.
+ */
+typedef void (*neighbor_report_cb_t)(const struct neighbor_report *report, void *user_data);
+
+/** @brief Record a beacon from a neighbor.
+ *
+ * Constant time and heap-free, safe to call from the Bluetooth RX context. When the probe
+ * window of the address is full, the stalest neighbor in it is replaced.
+ * Beacons of the same advertising window narrow down when the window started, which gives the
+ * prediction of the neighbor's next window.
+ *
+ * @param[in] addr Address of the neighbor.
+ * @param[in] rssi RSSI of the beacon in dBm.
+ * @param[in] epoch Current BLEnd epoch.
+ * @param[in] now Uptime in milliseconds when the beacon was received.
+ * @param[in] beacon Schedule carried by the beacon, NULL if it carries none.
+ *
+ * @retval 1 If the neighbor was not in the table before.
+ * @retval 0 If an existing neighbor was updated.
+ */
+int neighbor_update(const bt_addr_le_t *addr, int8_t rssi, uint32_t epoch, int64_t now,
+		    const struct neighbor_beacon *beacon);
+
+/** @brief Record whether a neighbor has heard us.
+ *
+ * Constant time, safe to call from the Bluetooth RX context.
+ *
+ * @param[in] addr Address of the neighbor.
+ * @param[in] hears_us What the neighbor's last beacon says.
+ *
+ * @retval 0 If the neighbor was updated.
+ * @retval -ENOENT If the neighbor is not in the table.
+ */
+int neighbor_hears_us_set(const bt_addr_le_t *addr, enum neighbor_hears_us hears_us);
+
+/** @brief Look up a neighbor.
+ *
+ * @param[in] addr Address of the neighbor.
+ * @param[out] neighbor Copy of the table entry.
+ *
+ * @retval 0 If the neighbor was found.
+ * @retval -ENOENT If the neighbor is not in the table.
+ */
+int neighbor_lookup(const bt_addr_le_t *addr, struct neighbor *neighbor);
+
+/** @brief Predict when a neighbor advertises next.
+ *
+ * Projects the last advertising window the neighbor was heard in forward by whole epochs of
+ * the neighbor, to the first window that has not ended by @p now.
+ *
+ * @param[in] addr Address of the neighbor.
+ * @param[in] now Uptime in milliseconds to predict from.
+ * @param[out] start Earliest uptime in milliseconds the window can start.
+ * @param[out] end Latest uptime in milliseconds the window can end.
+ *
+ * @retval 0 If a window was predicted.
+ * @retval -ENOENT If the neighbor is not in the table.
+ * @retval -ENODATA If the neighbor's beacons carry no schedule.
+ */
+int neighbor_next_window(const bt_addr_le_t *addr, int64_t now, int64_t *start, int64_t *end);
+
+/** @brief Call a function for every neighbor in the table.
+ *
+ * The callback gets a copy of each entry and runs without the table lock held.
+ *
+ * @param[in] cb Callback function.
+ * @param[in] user_data Passed to the callback.
+ */
+void neighbor_foreach(neighbor_cb_t cb, void *user_data);
+
+/** @brief Number of neighbors in the table. */
+int neighbor_count(void);
+
+/** @brief Copy the neighbor table counters. */
+void neighbor_stats_get(struct neighbor_table_stats *stats);
+
+/** @brief Remove every neighbor from the table. */
+void neighbor_clear(void);
+
+/** @brief Register the callback for the per-epoch neighbor-set report.
+ *
+ * @param[in] cb Callback function, NULL to stop the reports.
+ * @param[in] user_data Passed to the callback.
+ */
+void neighbor_report_cb_register(neighbor_report_cb_t cb, void *user_data);
+
+/** @brief Notify the table of an epoch boundary.
+ *
+ * Safe to call from ISR context. Aging and the neighbor-set report of the epoch that has just
+ * ended run later on the system workqueue.
+ *
+ * @param[in] epoch The epoch that has just started.
+ */
+void neighbor_epoch_boundary(uint32_t epoch);
+
+#endif
@@ -1,20 +1,32 @@
 #include "blend.h"
 #include "advertiser_scanner.h"
 #include "my_lbs.h"
+#include "neighbor.h"
+#include "blend_calib.h"
+#include "heard_filter.h"
+#include "blend_group.h"
+#include "blend_jitter.h"
+#include "blend_trace.h"
+#include "blend_energy.h"
 
+#include <zephyr/sys/byteorder.h>
 
-LOG_MODULE_REGISTER(BLEnd_CONN_ADV_SCAN, LOG_LEVEL_DBG);
 
+LOG_MODULE_REGISTER(BLEnd_CONN_ADV_SCAN, LOG_LEVEL_DBG);
 
 // Define the k_work structs here.
 // This is where the memory is allocated.
 struct k_work adv_work;
 struct k_work adv_stop;
+struct k_work adv_param_work;
 struct k_work scan_work;
 struct k_work scan_stop;
+static struct k_work adv_data_work;
 
 static void adv_work_handler(struct k_work *work);
+static void adv_data_handler(struct k_work *work);
 static void adv_stop_handler(struct k_work *work);
+static void adv_param_handler(struct k_work *work);
 
 
 static bool parse_adv_data_cb(struct bt_data *data, void *user_data);
@@ -24,16 +36,32 @@ static void scan_filter_match(struct bt_scan_device_info *device_info,
 static int scan_start(void);
 static void scan_work_handler(struct k_work *item);
 static void scan_stop_handler(struct k_work *item);
-static const struct bt_le_scan_param my_scan_param = {
+static struct bt_le_scan_param my_scan_param = {
     .type = BT_LE_SCAN_TYPE_PASSIVE, // Use passive scanning
-    .interval = BT_GAP_SCAN_SLOW_INTERVAL_1, 
-    .window = BT_GAP_SCAN_SLOW_INTERVAL_1,    
+    .interval = BT_GAP_SCAN_SLOW_INTERVAL_1, // time per channel, set by scan_channel_window_set
+    .window = BT_GAP_SCAN_SLOW_INTERVAL_1,
     .options = BT_LE_SCAN_OPT_NONE,        // No special options, or BT_LE_SCAN_OPT_FILTER_DUPLICATE for common usage
-    .timeout = 0,                          // Scan indefinitely (0 means no timeout)
+    .timeout = 0,                          // set by scan_window_set, the controller ends the scan
 };
 
+/* nominal end of the running scan window, in hardware cycles */
+static uint32_t scan_end_cyc;
+/* start advertising from the scan timeout; off for the short scans of sync maintenance epochs */
+static bool scan_chain_adv = true;
+static struct adv_handoff_stats handoff_stats;
+
 
 static int broadcast_stop = 0;  // adv cycle count
+/* Schedule for the next advertising window, set by BLEnd, and application data, set by
+ * adv_app_data_set. Both are written into the payload on the BLEnd workqueue. */
+static struct neighbor_beacon adv_schedule;
+static uint8_t adv_app_data[ADV_APP_DATA_MAX];
+static uint8_t adv_app_len;
+static atomic_t adv_schedule_dirty;
+/* Persistent advertising set, created once in adv_init and restarted every epoch */
+static struct bt_le_ext_adv *adv_set;
+/* Length of the next advertising window, as a controller-side event count and duration */
+static struct bt_le_ext_adv_start_param adv_start_param;
 /* BLE Advertising Parameters variable */
 static struct bt_le_adv_param *adv_param =
 	BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE, /* connectable */
@@ -41,91 +69,280 @@ static struct bt_le_adv_param *adv_param =
 			500, /* assign an initial value first */
 			NULL); /* Set to NULL for undirected advertising */
 
+/* PDU layout for the airtime of one advertising event */
+#define ADV_ADDR_LEN 6
+#define ADV_EXT_IND_LEN 7	// extended header length and mode, flags, ADI, AuxPtr
+#define ADV_AUX_HDR_LEN 10	// extended header length and mode, flags, AdvA, ADI
+#define ADV_SYNC_INFO_LEN 18	// SyncInfo of the periodic train, see adv_periodic_start
+
 /* Declare the Company identifier (Company ID) */
 #define COMPANY_ID_CODE 0x0059
 #define BLEND_IDENTIFIER  0xFE
 typedef struct adv_mfg_data {
 	uint16_t company_code; /* Company Identifier Code. */
 	uint16_t blend_id; /* sequence number */
-} adv_mfg_data_type;
-
+	/* Schedule of the sender, little endian, see struct neighbor_beacon */
+	uint16_t epoch; /* epoch counter, modulo 2^16 */
+	uint16_t epoch_ms; /* epoch length */
+	uint16_t phase_ms; /* start of this advertising window within the epoch */
+	uint16_t window_ms; /* longest this advertising window can last */
+	uint8_t app[ADV_APP_DATA_MAX]; /* application data, adv_app_data_set */
+} __packed adv_mfg_data_type;
+/* The scan filter only matches the identifier, so the schedule can change every epoch */
+#define ADV_MFG_PREFIX_LEN offsetof(adv_mfg_data_type, epoch)
+#define ADV_MFG_FIXED_LEN offsetof(adv_mfg_data_type, app)
+
+BUILD_ASSERT(ADV_MFG_FIXED_LEN == 12, "ADV_APP_DATA_MAX assumes 12 bytes of manufacturer data");
+
+/* Manufacturer data of our beacons. bt_le_ext_adv_set_data copies it, so it can be rebuilt while
+ * the set is advertising; the controller switches to the new payload at an event boundary. */
+static adv_mfg_data_type adv_mfg_buf = { COMPANY_ID_CODE, BLEND_IDENTIFIER };
 
-/* Define and initialize a variable of type adv_mfg_data_type */
-static adv_mfg_data_type adv_mfg_data = { COMPANY_ID_CODE, BLEND_IDENTIFIER };
+/**
+ * @brief Builds the advertising packet around the manufacturer data
+ *
+ * @param ad Destination for the three AD structures
+ * @param mfg Manufacturer data
+ * @param mfg_len Length of the manufacturer data, application data included
+ */
+static void adv_data_build(struct bt_data ad[3], const adv_mfg_data_type *mfg, size_t mfg_len)
+{
+    static const uint8_t flags = BT_LE_AD_NO_BREDR; // no BR/EDR support
 
-/* Declare the advertising packet */
-static const struct bt_data ad[] = {
-	/* Set the advertising flags */
-	BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_NO_BREDR), // no BR/EDR support
-	/* Set the advertising packet data: device name and manufacturer data */
-	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN), 
-	BT_DATA(BT_DATA_MANUFACTURER_DATA, (unsigned char *)&adv_mfg_data, sizeof(adv_mfg_data)),   
+    // manufacturer data first, so it sits at a fixed offset (ADV_MFG_DATA_OFFSET) that the
+    // scanner can check without walking the payload
+    ad[0] = (struct bt_data)BT_DATA(BT_DATA_FLAGS, &flags, sizeof(flags));
+    ad[1] = (struct bt_data)BT_DATA(BT_DATA_MANUFACTURER_DATA, mfg, mfg_len);
+    ad[2] = (struct bt_data)BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN);
+}
 
-};
+/* Offset of the manufacturer data value in the payload: behind the 3-byte flags AD structure and
+ * the length and type bytes of its own AD structure */
+#define ADV_MFG_DATA_OFFSET 5
 
 
 // Define the bt_scan_manufacturer_data struct for the filter
 // It holds a pointer to your filter data and its length
 static struct bt_scan_manufacturer_data mfg_filter = {
-    .data = (uint8_t *)&adv_mfg_data,
-    .data_len = sizeof(adv_mfg_data),
+    .data = (uint8_t *)&adv_mfg_buf,
+    .data_len = ADV_MFG_PREFIX_LEN,
 };
 
-
 /**
  * @brief Starts the advertising process
  *
+ * The controller ends the advertising window on its own after the number of events (or the
+ * duration) set by adv_window_set, so no timer or work item is needed to stop it.
+ *
  * @param *work Workqueue thread for starting advertising
  */
-
-void adv_work_handler(struct k_work *work)
-
+static int adv_start(void)
 {
     int err_start;
-    // adv date: ad, no scan response data
-    err_start = bt_le_adv_start(adv_param, ad, ARRAY_SIZE(ad), NULL, 0);
+    err_start = bt_le_ext_adv_start(adv_set, &adv_start_param);
     if (err_start) {
         LOG_ERR("Advertising failed to start (err %d)", err_start);
-    } else {
-        LOG_DBG("Advertising started (%d times)", broadcast_stop + 1);
+        return err_start;
+    }
+    if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+        blend_trace_adv_on(adv_start_param.num_events, adv_start_param.timeout * 10);
+    }
+    if (IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+        blend_energy_adv_on();
     }
 	dk_set_led(ADVERTISE_LED, 1); // turn on the advertising LED
+    return 0;
+}
+
+/**
+ * @brief Hands the schedule and application data to the controller, if either has changed
+ *
+ * Runs on the BLEnd workqueue only, so there is a single writer of adv_mfg_buf. The set may
+ * be advertising: the new payload replaces the old one from the next event on.
+ */
+static void adv_data_update(void)
+{
+    adv_mfg_data_type *mfg = &adv_mfg_buf;
+    struct neighbor_beacon schedule;
+    struct bt_data ad[3];
+    size_t app_len;
+    unsigned int key;
+    int err;
+
+    if (!atomic_cas(&adv_schedule_dirty, 1, 0)) {
+        return;
+    }
+    key = irq_lock();
+    schedule = adv_schedule;
+    app_len = adv_app_len;
+    memcpy(mfg->app, adv_app_data, app_len);
+    irq_unlock(key);
+
+    mfg->epoch = sys_cpu_to_le16(schedule.epoch);
+    mfg->epoch_ms = sys_cpu_to_le16(schedule.epoch_ms);
+    mfg->phase_ms = sys_cpu_to_le16(schedule.phase_ms);
+    mfg->window_ms = sys_cpu_to_le16(schedule.window_ms);
+    adv_data_build(ad, mfg, ADV_MFG_FIXED_LEN + app_len);
+    err = bt_le_ext_adv_set_data(adv_set, ad, ARRAY_SIZE(ad), NULL, 0);
+    if (err) {
+        LOG_ERR("Advertising data failed to update (err %d)", err);
+    }
+}
+
+/**
+ * @brief Pushes a payload change to the running advertising set
+ *
+ * @param *work Workqueue thread for updating the advertising data
+ */
+static void adv_data_handler(struct k_work *work)
+{
+    adv_data_update();
+}
+
+static void adv_work_handler(struct k_work *work)
+{
+    blend_work_begin();
+    adv_data_update();
+    (void)adv_start();
 }
 
 /**
  * @brief stops the advertising process
  *
+ * Only needed to cut a window short, e.g. when BLEnd is stopped.
+ *
  * @param *work Workqueue thread for stoping advertising
  */
-void adv_stop_handler(struct k_work *work)
+static void adv_stop_handler(struct k_work *work)
 {
     int err_stop;
-    err_stop = bt_le_adv_stop();
+    err_stop = bt_le_ext_adv_stop(adv_set);
     if (err_stop) {
         LOG_ERR("Advertising failed to stop (err %d)", err_stop);
+    } else if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+        blend_trace_adv_off(0, BLEND_TRACE_END_STOPPED);
     } else {
-        broadcast_stop++;
-       LOG_DBG("Advertising stopped (%d times)", broadcast_stop);
+        LOG_DBG("Advertising stopped");
+    }
+    if (!err_stop && IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+        blend_energy_adv_off(0);
+    }
+	dk_set_led(ADVERTISE_LED, 0); // turn off the advertising LED
+}
+
+/**
+ * @brief Hands the interval set by adv_interval_set to the controller
+ *
+ * The set must not be advertising, so BLEnd submits this at an epoch boundary.
+ *
+ * @param *work Workqueue thread for updating the advertising parameters
+ */
+static void adv_param_handler(struct k_work *work)
+{
+    int err;
+
+    err = bt_le_ext_adv_update_param(adv_set, adv_param);
+    if (err) {
+        LOG_ERR("Advertising parameters failed to update (err %d)", err);
+        return;
     }
+    LOG_DBG("Advertising interval set to %u", adv_param->interval_min);
+    if (IS_ENABLED(CONFIG_BLEND_CALIB)) {
+        // neighbors measure their delay samples against the interval the controller now uses
+        (void)blend_calib_publish(adv_param->interval_min);
+    }
+}
+
+/**
+ * @brief Called by the stack when the controller has ended an advertising window
+ *
+ * @param adv Advertising set
+ * @param info Number of advertising events completed
+ */
+static void adv_sent(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_sent_info *info)
+{
+    broadcast_stop++;
+	dk_set_led(ADVERTISE_LED, 0); // turn off the advertising LED
+    if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+        blend_trace_adv_off(info->num_sent, BLEND_TRACE_END_TIMEOUT);
+    }
+    if (IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+        blend_energy_adv_off(info->num_sent);
+    }
+}
+
+/**
+ * @brief Called by the stack when a peer connects to the advertising set
+ *
+ * The controller stops advertising on the set when it connects.
+ *
+ * @param adv Advertising set
+ * @param info Connection information
+ */
+static void adv_connected(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_connected_info *info)
+{
 	dk_set_led(ADVERTISE_LED, 0); // turn off the advertising LED
+    if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+        blend_trace_adv_off(0, BLEND_TRACE_END_CONNECTED);
+    } else {
+        LOG_DBG("Advertising ended by a connection");
+    }
+    if (IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+        blend_energy_adv_off(0);
+    }
+}
+
+static const struct bt_le_ext_adv_cb adv_cb = {
+    .sent = adv_sent,
+    .connected = adv_connected,
+};
+
+/**
+ * @brief  Sets the length of the next advertising windows
+ * @param  num_events  Number of advertising events before the controller stops, 0 for no limit.
+ * @param  duration_ms Upper bound on the window in milliseconds, 0 for no limit.
+ */
+void adv_window_set(int num_events, int duration_ms)
+{
+    // num_events is a uint8_t in the HCI command; longer windows rely on the duration alone
+    adv_start_param.num_events = num_events <= UINT8_MAX ? num_events : 0;
+    adv_start_param.timeout = DIV_ROUND_UP(duration_ms, 10); // N * 10 ms
 }
 
 /** 
- * @brief  Initializes the advertising parameters and sets up the work (starting and stopping advertising)
+ * @brief  Initializes the advertising parameters, creates the advertising set and sets up the work
+ *          (starting and stopping advertising)
  * @param  adv_interval  Advertising interval in units of 0.625 milliseconds.
  *          This value is passed from main and can be set by the user to different values.
  *
  */
 void adv_init(int adv_interval)
 {
+    int err;
+
     adv_param->interval_max =adv_interval;
     adv_param->interval_min = adv_interval;
     k_work_init(&adv_work, adv_work_handler);
     k_work_init(&adv_stop, adv_stop_handler);
+    k_work_init(&adv_param_work, adv_param_handler);
+    k_work_init(&adv_data_work, adv_data_handler);
+
+    // neighbors key their tables and heard-neighbors filters on the address we advertise from
+    adv_param->options |= BT_LE_ADV_OPT_USE_IDENTITY;
+    // legacy or extended PDUs from the start, BLEnd selects the profile later
+    adv_phy_set(BLEND_PHY_1M);
+    err = bt_le_ext_adv_create(adv_param, &adv_cb, &adv_set);
+    if (err) {
+        LOG_ERR("Advertising set failed to create (err %d)", err);
+        return;
+    }
+    // the first window starts with the schedule set by BLEnd; until then an empty schedule
+    atomic_set(&adv_schedule_dirty, 1);
+    adv_data_update();
 }
 
 // parses the advertising data to extract the device name.
-bool parse_adv_data_cb(struct bt_data *data, void *user_data)
+static bool parse_adv_data_cb(struct bt_data *data, void *user_data)
 {
      char *name_buffer = (char *)user_data;
 
@@ -141,7 +358,6 @@ bool parse_adv_data_cb(struct bt_data *data, void *user_data)
                 memcpy(name_buffer, data->data, MAX_DEVICE_NAME_LEN - 1);
                 name_buffer[MAX_DEVICE_NAME_LEN - 1] = '\0';
             }
-            LOG_INF("device name: %s", name_buffer);
             return false; // stop parsing further data
         default:
             // if the data type is not name, continue parsing
@@ -149,27 +365,220 @@ bool parse_adv_data_cb(struct bt_data *data, void *user_data)
     }
 }
 
-// The callback function when a scan filter match occurs.
-void scan_filter_match(struct bt_scan_device_info *device_info,
+/**
+ * @brief Returns the offset of the BLEnd manufacturer data in a payload
+ *
+ * Only the fixed offset our own beacons use is checked, so the cost does not depend on the
+ * payload length. Payloads laid out differently are reported as DISCOVERY_NO_MFG_DATA and
+ * left to the consumer to parse.
+ */
+static uint8_t scan_mfg_data_offset(const struct net_buf_simple *buf)
+{
+	if (buf->len < ADV_MFG_DATA_OFFSET + ADV_MFG_PREFIX_LEN ||
+	    buf->data[ADV_MFG_DATA_OFFSET - 1] != BT_DATA_MANUFACTURER_DATA ||
+	    memcmp(&buf->data[ADV_MFG_DATA_OFFSET], &adv_mfg_buf, ADV_MFG_PREFIX_LEN) != 0) {
+		return DISCOVERY_NO_MFG_DATA;
+	}
+	return ADV_MFG_DATA_OFFSET;
+}
+
+/**
+ * @brief Reads the sender's schedule from the BLEnd manufacturer data
+ *
+ * @param buf Advertising payload
+ * @param off Offset of the manufacturer data, as returned by scan_mfg_data_offset
+ * @param beacon Destination for the schedule
+ *
+ * @retval true If the beacon carries a schedule.
+ */
+static bool scan_beacon_parse(const struct net_buf_simple *buf, uint8_t off,
+			      struct neighbor_beacon *beacon)
+{
+	const uint8_t *mfg = &buf->data[off];
+
+	// the AD length byte counts the type byte too
+	if (off == DISCOVERY_NO_MFG_DATA || buf->data[off - 2] < 1 + ADV_MFG_FIXED_LEN ||
+	    buf->len < off + ADV_MFG_FIXED_LEN) {
+		return false;
+	}
+	beacon->epoch = sys_get_le16(mfg + offsetof(adv_mfg_data_type, epoch));
+	beacon->epoch_ms = sys_get_le16(mfg + offsetof(adv_mfg_data_type, epoch_ms));
+	beacon->phase_ms = sys_get_le16(mfg + offsetof(adv_mfg_data_type, phase_ms));
+	beacon->window_ms = sys_get_le16(mfg + offsetof(adv_mfg_data_type, window_ms));
+	return beacon->epoch_ms != 0;
+}
+
+/**
+ * @brief Finds the application data behind the BLEnd fields
+ *
+ * @param payload Advertising payload
+ * @param len Length of the payload
+ * @param off Offset of the manufacturer data, as returned by scan_mfg_data_offset
+ * @param data Set to the start of the application data within the payload
+ *
+ * @return Length of the application data, 0 if the beacon carries none.
+ */
+static size_t scan_app_data(const uint8_t *payload, size_t len, uint8_t off, const uint8_t **data)
+{
+	size_t mfg_len; // AD length: type byte and data
+
+	if (off == DISCOVERY_NO_MFG_DATA || len <= off) {
+		return 0;
+	}
+	// the AD length byte counts the type byte too
+	mfg_len = MIN((size_t)payload[off - 2], len - off + 1);
+	if (mfg_len <= 1 + ADV_MFG_FIXED_LEN) {
+		return 0;
+	}
+	*data = &payload[off + ADV_MFG_FIXED_LEN];
+	return mfg_len - 1 - ADV_MFG_FIXED_LEN;
+}
+
+/**
+ * @brief The callback function when a scan filter match occurs
+ *
+ * Runs in the BT receive path, so it only updates the neighbor table and hands a raw record of
+ * the beacon to the discovery ring. Address formatting and name parsing are left to the
+ * application thread that drains the ring.
+ */
+static void scan_filter_match(struct bt_scan_device_info *device_info,
 			      struct bt_scan_filter_match *filter_match,
 			      bool connectable)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-	char device_name[MAX_DEVICE_NAME_LEN] = {0};
+	uint32_t cyc = k_cycle_get_32();
+	const struct net_buf_simple *buf = device_info->adv_data;
+	struct discovery_event event;
+	struct neighbor_beacon beacon;
+	uint8_t mfg_data_off = scan_mfg_data_offset(buf);
+	uint32_t epoch = blend_epoch_get();
+	const uint8_t *app = NULL;
+	size_t app_len = scan_app_data(buf->data, buf->len, mfg_data_off, &app);
+	int is_new;
+
+	is_new = neighbor_update(device_info->recv_info->addr, device_info->recv_info->rssi,
+				 epoch, k_uptime_get(),
+				 scan_beacon_parse(buf, mfg_data_off, &beacon) ? &beacon : NULL);
+	if (is_new < 0) {
+		return;
+	}
+	if (IS_ENABLED(CONFIG_BLEND_CALIB)) {
+		blend_calib_beacon(device_info->recv_info->addr, cyc, app, app_len,
+				   my_scan_param.interval * 625);
+	}
+	if (IS_ENABLED(CONFIG_BLEND_GROUP) && device_info->recv_info->interval) {
+		// the beacon carries the sync info of a periodic train
+		blend_group_beacon(device_info->recv_info);
+	}
+	if (IS_ENABLED(CONFIG_BLEND_HEARD_FILTER)) {
+		heard_filter_beacon(device_info->recv_info->addr, app, app_len);
+	}
 
-	bt_addr_le_to_str(device_info->recv_info->addr, addr, sizeof(addr));
-	bt_data_parse(device_info->adv_data, parse_adv_data_cb, device_name);
+	bt_addr_le_copy(&event.addr, device_info->recv_info->addr);
+	event.rssi = device_info->recv_info->rssi;
+	event.connectable = connectable;
+	event.is_new = is_new;
+	event.epoch = epoch;
+	event.timestamp = k_uptime_get_32();
+	event.mfg_data_off = mfg_data_off;
+	event.data_len = MIN(buf->len, sizeof(event.data));
+	memcpy(event.data, buf->data, event.data_len);
+
+	if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+		blend_trace_match(&event.addr, event.rssi, connectable, is_new);
+	}
+	if (IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+		blend_energy_rx();
+	}
+	(void)discovery_ring_put(&event);
+}
 
-	LOG_INF("Filters matched. Address: %s connectable: %d",
-		addr, connectable);
+/**
+ * @brief  Formats and logs a discovery event
+ *
+ * Parses the name from the payload copy, so call it from the consumer thread, not the scan callback.
+ * @param  event  Event taken from the discovery ring
+ */
+void scan_event_log(const struct discovery_event *event)
+{
+	struct net_buf_simple buf;
+	char addr[BT_ADDR_LE_STR_LEN];
+	char device_name[MAX_DEVICE_NAME_LEN] = {0};
+	const uint8_t *app;
+	size_t app_len;
+
+	net_buf_simple_init_with_data(&buf, (void *)event->data, event->data_len);
+	bt_data_parse(&buf, parse_adv_data_cb, device_name);
+	bt_addr_le_to_str(&event->addr, addr, sizeof(addr));
+
+	LOG_INF("%s %s (%s) rssi %d connectable %d in epoch %u%s",
+		event->is_new ? "New neighbor" : "Neighbor", addr, device_name, event->rssi,
+		event->connectable, event->epoch,
+		event->mfg_data_off == DISCOVERY_NO_MFG_DATA ? ", BLEnd data not at the usual offset" : "");
+	app_len = scan_event_app_data(event, &app);
+	if (app_len) {
+		LOG_HEXDUMP_INF(app, app_len, "application data");
+	}
 }
 
 // Register the scan callback
 BT_SCAN_CB_INIT(scan_cb, scan_filter_match, NULL,
 		NULL, NULL);
 
+/**
+ * @brief Records one scan-to-advertise handoff
+ *
+ * @param cb_cyc Cycle count when the scan timeout callback was entered
+ */
+static void handoff_stats_update(uint32_t cb_cyc)
+{
+    uint32_t now = k_cycle_get_32();
+    int32_t gap = (int32_t)(now - scan_end_cyc);
+    uint32_t gap_us = k_cyc_to_us_floor32(gap > 0 ? gap : 0);
+    unsigned int key = irq_lock();
+
+    handoff_stats.count++;
+    handoff_stats.last_us = gap_us;
+    handoff_stats.sum_us += gap_us;
+    handoff_stats.max_us = MAX(handoff_stats.max_us, gap_us);
+    handoff_stats.min_us = handoff_stats.count == 1 ? gap_us : MIN(handoff_stats.min_us, gap_us);
+    handoff_stats.max_cb_us = MAX(handoff_stats.max_cb_us, k_cyc_to_us_floor32(now - cb_cyc));
+    irq_unlock(key);
+}
+
+/**
+ * @brief Called by the stack when the controller ends the scan window
+ *
+ * The advertising window is started right here instead of through the workqueue, so the radio
+ * goes from scanning to beaconing with only the HCI round trip in between.
+ */
+static void scan_timeout(void)
+{
+    uint32_t cb_cyc = k_cycle_get_32();
+
+	dk_set_led(SCAN_LED, 0); // turn off the scan LED
+    if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+        blend_trace_scan_off(BLEND_TRACE_END_TIMEOUT);
+    }
+    if (IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+        blend_energy_scan_off();
+    }
+    if (IS_ENABLED(CONFIG_BLEND_JITTER)) {
+        blend_jitter_record(BLEND_JITTER_SCAN_END, (int32_t)(cb_cyc - scan_end_cyc));
+    }
+    if (!scan_chain_adv) {
+        return;
+    }
+    if (adv_start() == 0) {
+        handoff_stats_update(cb_cyc);
+    }
+}
+
+static struct bt_le_scan_cb scan_timeout_cb = {
+    .timeout = scan_timeout,
+};
+
 //starts the scanning process.
-int scan_start(void)
+static int scan_start(void)
 {
 	int err;
 	//make sure the scan is stopped before starting a new one
@@ -182,26 +591,44 @@ int scan_start(void)
         return err;
     }
 
-	
+	err = bt_scan_params_set(&my_scan_param);
+	if (err) {
+		LOG_ERR("Failed to set scan parameters (err %d)", err);
+		return err;
+	}
 
 	err = bt_scan_start(BT_SCAN_TYPE_SCAN_PASSIVE);
 	if (err) {
 		LOG_ERR("Scanning failed to start (err %d)", err);
 		return err;
 	}
+	scan_end_cyc = k_cycle_get_32() +
+		(uint32_t)((uint64_t)my_scan_param.timeout * 10 * sys_clock_hw_cycles_per_sec() / MSEC_PER_SEC);
 	dk_set_led(SCAN_LED, 1); // turn on the scan LED
-	LOG_DBG("Scan started");
+	if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+		blend_trace_scan_on(my_scan_param.timeout * 10);
+	}
+	if (IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+		blend_energy_scan_on();
+	}
 	return 0;
 }
+
 /**
  * @brief Starts the scanning process
  *
+ * The controller ends the scan after the duration set by scan_window_set and the advertising
+ * window is chained from its timeout callback.
+ *
  * @param *work Workqueue thread for starting scanning
  */
-void scan_work_handler(struct k_work *item)
+static void scan_work_handler(struct k_work *item)
 {
 	ARG_UNUSED(item);
 
+	blend_work_begin();
+	// the advertising window follows the scan, so its payload is updated now
+	adv_data_update();
 	(void)scan_start();
 }
 
@@ -210,7 +637,7 @@ void scan_work_handler(struct k_work *item)
  *
  * @param *work Workqueue thread for stopping scanning
  */
-void scan_stop_handler(struct k_work *item)
+static void scan_stop_handler(struct k_work *item)
 {
 	ARG_UNUSED(item);
     int err;
@@ -223,7 +650,300 @@ void scan_stop_handler(struct k_work *item)
         return;
     }
 	dk_set_led(SCAN_LED, 0); // turn off the scan LED
-    LOG_DBG("scan stopped");
+    if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+        blend_trace_scan_off(BLEND_TRACE_END_STOPPED);
+    }
+    if (IS_ENABLED(CONFIG_BLEND_ENERGY)) {
+        blend_energy_scan_off();
+    }
+}
+
+/**
+ * @brief  Sets the advertising interval used from the next adv_param_work on
+ * @param  adv_interval  Advertising interval in units of 0.625 milliseconds.
+ */
+void adv_interval_set(int adv_interval)
+{
+    adv_param->interval_min = adv_interval;
+    adv_param->interval_max = adv_interval;
+}
+
+/**
+ * @brief  Sets the schedule carried by the next advertising window
+ *
+ * Safe to call from ISR context; the payload is rewritten when the next window is started.
+ * @param  schedule  Epoch counter, epoch length, phase and length of the window
+ */
+void adv_schedule_set(const struct neighbor_beacon *schedule)
+{
+    unsigned int key = irq_lock();
+
+    adv_schedule = *schedule;
+    irq_unlock(key);
+    atomic_set(&adv_schedule_dirty, 1);
+}
+
+/**
+ * @brief  Sets the length of the next scan windows
+ * @param  duration_ms  Scan window in milliseconds, rounded up to the controller's 10 ms unit.
+ * @param  chain_adv    Start the advertising window when the controller ends the scan.
+ */
+void scan_window_set(int duration_ms, bool chain_adv)
+{
+    my_scan_param.timeout = DIV_ROUND_UP(duration_ms, 10); // N * 10 ms
+    scan_chain_adv = chain_adv;
+}
+
+/**
+ * @brief  Selects the PHYs of the advertising set and of the scanner
+ *
+ * The set takes the new options with the next adv_param_work. The payload is handed to the
+ * controller again before the next window, since the profiles carry it in different PDUs.
+ * @param  phy  Radio profile
+ */
+void adv_phy_set(enum blend_phy phy)
+{
+    uint32_t options = adv_param->options &
+                       ~(BT_LE_ADV_OPT_EXT_ADV | BT_LE_ADV_OPT_NO_2M | BT_LE_ADV_OPT_CODED);
+
+    switch (phy) {
+    case BLEND_PHY_2M:
+        // extended advertising puts the payload on the 2M secondary PHY by default
+        options |= BT_LE_ADV_OPT_EXT_ADV;
+        my_scan_param.options = BT_LE_SCAN_OPT_NONE;
+        break;
+    case BLEND_PHY_CODED:
+        options |= BT_LE_ADV_OPT_EXT_ADV | BT_LE_ADV_OPT_CODED;
+        my_scan_param.options = BT_LE_SCAN_OPT_CODED | BT_LE_SCAN_OPT_NO_1M;
+        break;
+    default:
+        if (ADV_EXT_1M) {
+            // the payload does not fit a legacy PDU, or carries sync info: extended, all on 1M
+            options |= BT_LE_ADV_OPT_EXT_ADV | BT_LE_ADV_OPT_NO_2M;
+        }
+        my_scan_param.options = BT_LE_SCAN_OPT_NONE;
+        break;
+    }
+    adv_param->options = options;
+    atomic_set(&adv_schedule_dirty, 1);
+}
+
+/**
+ * @brief  Selects the primary channels of the advertising set
+ *
+ * The set takes the new options with the next adv_param_work.
+ * @param  channels  Mask of BLEND_CHAN_37, BLEND_CHAN_38 and BLEND_CHAN_39
+ */
+void adv_channels_set(uint8_t channels)
+{
+    uint32_t options = adv_param->options & ~(BT_LE_ADV_OPT_DISABLE_CHAN_37 |
+                                              BT_LE_ADV_OPT_DISABLE_CHAN_38 |
+                                              BT_LE_ADV_OPT_DISABLE_CHAN_39);
+
+    if (!(channels & BLEND_CHAN_37)) {
+        options |= BT_LE_ADV_OPT_DISABLE_CHAN_37;
+    }
+    if (!(channels & BLEND_CHAN_38)) {
+        options |= BT_LE_ADV_OPT_DISABLE_CHAN_38;
+    }
+    if (!(channels & BLEND_CHAN_39)) {
+        options |= BT_LE_ADV_OPT_DISABLE_CHAN_39;
+    }
+    adv_param->options = options;
+}
+
+/**
+ * @brief  Returns the on-air time of one PDU, header and CRC included
+ * @param  phy  PHY the PDU is sent on
+ * @param  len  Length of the PDU payload in bytes
+ */
+static uint32_t adv_pdu_us(enum blend_phy phy, size_t len)
+{
+    switch (phy) {
+    case BLEND_PHY_2M:
+        return (2 + 4 + 2 + len + 3) * 4; // preamble, access address, header, payload, CRC
+    case BLEND_PHY_CODED:
+        // S=8: preamble, access address, CI and TERM1 take 376 us, then 64 us per byte and TERM2
+        return 376 + (2 + len + 3) * 64 + 24;
+    default:
+        return (1 + 4 + 2 + len + 3) * 8;
+    }
+}
+
+/**
+ * @brief  Returns the airtime of one advertising event of a radio profile
+ *
+ * Counted from the start of the first PDU to the end of the last, so a scan window of one
+ * interval plus the random delay and this airtime holds a complete event.
+ * @param  phy       Radio profile
+ * @param  channels  Mask of the primary channels the event is sent on
+ */
+uint32_t adv_event_airtime_us(enum blend_phy phy, uint8_t channels)
+{
+    size_t data_len = adv_data_len_get();
+    int count = POPCOUNT(channels);
+    uint32_t primary = (count - 1) * CONFIG_BLEND_ADV_CHANNEL_GAP_US;
+
+    if (phy == BLEND_PHY_1M && !ADV_EXT_1M) {
+        // legacy PDU with the address and the data on every primary channel
+        return primary + count * adv_pdu_us(phy, ADV_ADDR_LEN + data_len);
+    }
+    // ADV_EXT_IND on every primary channel, then one AUX_ADV_IND with the data
+    primary += count *
+               adv_pdu_us(phy == BLEND_PHY_CODED ? BLEND_PHY_CODED : BLEND_PHY_1M, ADV_EXT_IND_LEN);
+    return primary + CONFIG_BLEND_ADV_AUX_GAP_US +
+           adv_pdu_us(phy, ADV_AUX_HDR_LEN + (IS_ENABLED(CONFIG_BLEND_GROUP) ? ADV_SYNC_INFO_LEN : 0) +
+                           data_len);
+}
+
+/**
+ * @brief  Returns the length of the advertising data our beacons carry, in bytes
+ */
+size_t adv_data_len_get(void)
+{
+    struct bt_data ad[3];
+    size_t len = 0;
+
+    // with the longest application data, so a layout stays valid whatever is published
+    adv_data_build(ad, &adv_mfg_buf, sizeof(adv_mfg_data_type));
+    for (size_t i = 0; i < ARRAY_SIZE(ad); i++) {
+        len += 2 + ad[i].data_len; // length and type bytes of the AD structure
+    }
+    return len;
+}
+
+/**
+ * @brief  Publishes application data in the BLEnd beacon
+ *
+ * The bytes follow the schedule in the manufacturer data. The running advertising set is
+ * updated in place from the BLEnd workqueue, without stopping it, so the next advertising event
+ * already carries them. Callable from any thread.
+ * @param  data  Application data, copied
+ * @param  len   Length of the data, at most ADV_APP_DATA_MAX
+ *
+ * @retval 0 If the data was queued for the next advertising event.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int adv_app_data_set(const void *data, size_t len)
+{
+    unsigned int key;
+
+    if (len > ADV_APP_DATA_MAX) {
+        return -EMSGSIZE;
+    }
+    key = irq_lock();
+    memcpy(adv_app_data, data, len);
+    adv_app_len = len;
+    irq_unlock(key);
+    atomic_set(&adv_schedule_dirty, 1);
+    blend_radio_submit(&adv_data_work);
+    return 0;
+}
+
+/**
+ * @brief  Starts periodic advertising on the BLEnd advertising set
+ *
+ * From then on every extended beacon carries the sync info of the train, so a neighbor that hears
+ * one can sync to it. The train runs on its own between the advertising windows.
+ * @param  interval  Periodic advertising interval in units of 1.25 milliseconds
+ * @param  ad  Data of the train
+ * @param  ad_len  Number of AD structures in ad
+ *
+ * @retval 0 If the train is running.
+ * @retval -ENOTSUP If the set is connectable, which periodic advertising does not allow.
+ */
+int adv_periodic_start(uint16_t interval, const struct bt_data *ad, size_t ad_len)
+{
+    int err;
+
+    if (!adv_set) {
+        return -ENODEV;
+    }
+    if (adv_param->options & BT_LE_ADV_OPT_CONNECTABLE) {
+        LOG_ERR("Periodic advertising needs a non-connectable advertising set");
+        return -ENOTSUP;
+    }
+    err = bt_le_per_adv_set_param(adv_set, BT_LE_PER_ADV_PARAM(interval, interval,
+                                                               BT_LE_PER_ADV_OPT_NONE));
+    if (err) {
+        LOG_ERR("Failed to set periodic advertising parameters (err %d)", err);
+        return err;
+    }
+    err = bt_le_per_adv_set_data(adv_set, ad, ad_len);
+    if (err) {
+        LOG_ERR("Failed to set periodic advertising data (err %d)", err);
+        return err;
+    }
+    err = bt_le_per_adv_start(adv_set);
+    if (err) {
+        LOG_ERR("Periodic advertising failed to start (err %d)", err);
+        return err;
+    }
+    LOG_INF("Periodic advertising started, interval %u", interval);
+    return 0;
+}
+
+/**
+ * @brief  Replaces the data of the running periodic advertising train
+ * @param  ad  Data of the train
+ * @param  ad_len  Number of AD structures in ad
+ */
+int adv_periodic_data_set(const struct bt_data *ad, size_t ad_len)
+{
+    if (!adv_set) {
+        return -ENODEV;
+    }
+    return bt_le_per_adv_set_data(adv_set, ad, ad_len);
+}
+
+/**
+ * @brief  Stops the periodic advertising train; the beacons stop carrying its sync info
+ */
+int adv_periodic_stop(void)
+{
+    if (!adv_set) {
+        return -ENODEV;
+    }
+    return bt_le_per_adv_stop(adv_set);
+}
+
+/**
+ * @brief  Returns the application data of a received BLEnd beacon
+ * @param  event  Event taken from the discovery ring
+ * @param  data   Set to the start of the application data within the event
+ *
+ * @return Length of the application data, 0 if the beacon carries none.
+ */
+size_t scan_event_app_data(const struct discovery_event *event, const uint8_t **data)
+{
+	return scan_app_data(event->data, event->data_len, event->mfg_data_off, data);
+}
+
+/**
+ * @brief  Sets how long the scanner stays on one primary channel
+ *
+ * Scanning is continuous (interval = window), and the controller moves to the next primary
+ * channel after every interval.
+ * @param  window_ms  Time per channel in milliseconds
+ */
+void scan_channel_window_set(int window_ms)
+{
+    uint32_t units = DIV_ROUND_UP(window_ms * 1000, 625);
+
+    my_scan_param.interval = CLAMP(units, 0x0004, 0x4000); // HCI range, 2.5 ms to 10.24 s
+    my_scan_param.window = my_scan_param.interval;
+}
+
+/**
+ * @brief  Copies the scan-to-advertise handoff statistics
+ * @param  stats  Destination for the statistics
+ */
+void adv_handoff_stats_get(struct adv_handoff_stats *stats)
+{
+    unsigned int key = irq_lock();
+
+    *stats = handoff_stats;
+    irq_unlock(key);
 }
 
 // Initializes the scan module.
@@ -239,6 +959,7 @@ void scan_init(void)
 
 	bt_scan_init(&scan_init);
 	bt_scan_cb_register(&scan_cb);
+	bt_le_scan_cb_register(&scan_timeout_cb);
 	bt_scan_filter_remove_all();
 
 	err = bt_scan_filter_add(BT_SCAN_FILTER_TYPE_MANUFACTURER_DATA,&mfg_filter );
@@ -256,6 +977,6 @@ void scan_init(void)
 
 	k_work_init(&scan_work, scan_work_handler);
     k_work_init(&scan_stop, scan_stop_handler);
-	LOG_DBG("Scan module initialized");
+	LOG_INF("Scan module initialized");
 }
 
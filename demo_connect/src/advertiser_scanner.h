@@ -1,3 +1,6 @@
+#ifndef ADV_SCAN_CONN
+#define ADV_SCAN_CONN
+
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
@@ -9,20 +12,68 @@
 #include <bluetooth/scan.h>
 
 #include <dk_buttons_and_leds.h>
-
-#define SCAN_LED DK_LED2
-#define ADVERTISE_LED DK_LED3
+#include "blend.h"
+#include "discovery_ring.h"
+#include "neighbor.h"
 
 #define MAX_DEVICE_NAME_LEN 30
 #define DEVICE_NAME CONFIG_BT_DEVICE_NAME
 #define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
+/* Room for application data in a legacy advertising PDU, behind the flags, the BLEnd
+ * manufacturer data (company ID, identifier and schedule) and the name */
+#define ADV_LEGACY_APP_ROOM (BT_GAP_ADV_MAX_ADV_DATA_LEN - 3 - (2 + 12) - (2 + DEVICE_NAME_LEN))
+/* More application data than that needs extended advertising, also in the 1M profile */
+#define ADV_EXT_PAYLOAD (CONFIG_BLEND_BEACON_DATA_MAX > ADV_LEGACY_APP_ROOM)
+/* Extended advertising in the 1M profile: a payload beyond the legacy room, or the sync info of
+ * the group channel */
+#define ADV_EXT_1M (ADV_EXT_PAYLOAD || IS_ENABLED(CONFIG_BLEND_GROUP))
+#define ADV_APP_DATA_MAX MAX(CONFIG_BLEND_BEACON_DATA_MAX, ADV_LEGACY_APP_ROOM)
 // Declare the k_work structs as 'extern'.
 // This tells the compiler that these variables exist, but their
 // memory is allocated (defined) in another .c file.
 extern struct k_work adv_work;
 extern struct k_work adv_stop;
+extern struct k_work adv_param_work;
 extern struct k_work scan_work;
 extern struct k_work scan_stop;
 
+/** @brief Scan-to-advertise handoff latency.
+ *
+ * The gap runs from the nominal end of the scan window to the advertising set running again,
+ * the callback time from the controller's scan timeout event to the same point.
+ */
+struct adv_handoff_stats {
+	uint32_t count;     /**< Number of handoffs measured. */
+	uint32_t last_us;   /**< Most recent gap. */
+	uint32_t min_us;    /**< Smallest gap. */
+	uint32_t max_us;    /**< Largest gap. */
+	uint32_t max_cb_us; /**< Largest time spent in the scan timeout callback. */
+	uint64_t sum_us;    /**< Sum of all gaps, for the mean. */
+};
+
 void adv_init(int adv_interval);
-void scan_init(void);
\ No newline at end of file
+void adv_window_set(int num_events, int duration_ms);
+void adv_interval_set(int adv_interval);
+void adv_phy_set(enum blend_phy phy);
+void adv_channels_set(uint8_t channels);
+uint32_t adv_event_airtime_us(enum blend_phy phy, uint8_t channels);
+void adv_schedule_set(const struct neighbor_beacon *schedule);
+int adv_app_data_set(const void *data, size_t len);
+size_t adv_data_len_get(void);
+int adv_periodic_start(uint16_t interval, const struct bt_data *ad, size_t ad_len);
+int adv_periodic_data_set(const struct bt_data *ad, size_t ad_len);
+int adv_periodic_stop(void);
+void adv_handoff_stats_get(struct adv_handoff_stats *stats);
+void scan_init(void);
+void scan_window_set(int duration_ms, bool chain_adv);
+void scan_channel_window_set(int window_ms);
+void scan_event_log(const struct discovery_event *event);
+size_t scan_event_app_data(const struct discovery_event *event, const uint8_t **data);
+
+
+
+#define SCAN_LED DK_LED2
+#define ADVERTISE_LED DK_LED3
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "beacon_tlv.h"
+#include "advertiser_scanner.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* entries in the order they were set; the whole buffer is handed to adv_app_data_set */
+static uint8_t tlv_buf[ADV_APP_DATA_MAX];
+static size_t tlv_len;
+static K_MUTEX_DEFINE(tlv_lock);
+
+/**
+ * @brief Finds the entry of a type
+ *
+ * @param data Entries
+ * @param len Length of the entries
+ * @param type Type to look for
+ * @param off Set to the offset of the entry
+ *
+ * @retval 0 If the entry was found.
+ * @retval -ENOENT If there is no entry of this type.
+ * @retval -EBADMSG If an entry runs past the end.
+ */
+static int tlv_find(const uint8_t *data, size_t len, uint8_t type, size_t *off)
+{
+	size_t i = 0;
+
+	while (i < len) {
+		if (len - i < BEACON_TLV_OVERHEAD || len - i - BEACON_TLV_OVERHEAD < data[i + 1]) {
+			return -EBADMSG;
+		}
+		if (data[i] == type) {
+			*off = i;
+			return 0;
+		}
+		i += BEACON_TLV_OVERHEAD + data[i + 1];
+	}
+	return -ENOENT;
+}
+
+// drops an entry of the published buffer
+static void tlv_drop(size_t off)
+{
+	size_t entry_len = BEACON_TLV_OVERHEAD + tlv_buf[off + 1];
+
+	memmove(&tlv_buf[off], &tlv_buf[off + entry_len], tlv_len - off - entry_len);
+	tlv_len -= entry_len;
+}
+
+int beacon_tlv_set(uint8_t type, const void *value, uint8_t len)
+{
+	size_t off, room;
+	int err;
+
+	k_mutex_lock(&tlv_lock, K_FOREVER);
+	room = sizeof(tlv_buf) - tlv_len;
+	if (tlv_find(tlv_buf, tlv_len, type, &off) == 0) {
+		room += BEACON_TLV_OVERHEAD + tlv_buf[off + 1];
+		if (room < BEACON_TLV_OVERHEAD + len) {
+			k_mutex_unlock(&tlv_lock);
+			return -ENOSPC;
+		}
+		tlv_drop(off);
+	} else if (room < BEACON_TLV_OVERHEAD + len) {
+		k_mutex_unlock(&tlv_lock);
+		return -ENOSPC;
+	}
+	tlv_buf[tlv_len] = type;
+	tlv_buf[tlv_len + 1] = len;
+	memcpy(&tlv_buf[tlv_len + BEACON_TLV_OVERHEAD], value, len);
+	tlv_len += BEACON_TLV_OVERHEAD + len;
+	err = adv_app_data_set(tlv_buf, tlv_len);
+	k_mutex_unlock(&tlv_lock);
+	return err;
+}
+
+int beacon_tlv_remove(uint8_t type)
+{
+	size_t off;
+	int err;
+
+	k_mutex_lock(&tlv_lock, K_FOREVER);
+	err = tlv_find(tlv_buf, tlv_len, type, &off);
+	if (err) {
+		k_mutex_unlock(&tlv_lock);
+		return -ENOENT;
+	}
+	tlv_drop(off);
+	err = adv_app_data_set(tlv_buf, tlv_len);
+	k_mutex_unlock(&tlv_lock);
+	return err;
+}
+
+int beacon_tlv_get(const uint8_t *data, size_t len, uint8_t type, const uint8_t **value)
+{
+	size_t off;
+	int err;
+
+	err = tlv_find(data, len, type, &off);
+	if (err) {
+		return err;
+	}
+	*value = &data[off + BEACON_TLV_OVERHEAD];
+	return data[off + 1];
+}
@@ -0,0 +1,58 @@
+#ifndef BEACON_TLV_CONN
+#define BEACON_TLV_CONN
+
+#include <zephyr/kernel.h>
+
+/* Typed values in the BLEnd beacon
+ *
+ * The application data of the beacon is a sequence of entries of one type byte, one length byte
+ * and the value. Types are defined by the application; every node that hears the beacon can read
+ * the values without connecting. Types from BEACON_TLV_RESERVED on are used by BLEnd itself.
+ */
+
+/** Bytes an entry takes in the beacon on top of its value. */
+#define BEACON_TLV_OVERHEAD 2
+
+/** First type reserved for BLEnd. */
+#define BEACON_TLV_RESERVED 0xF0
+/** Advertising interval of the sender, see blend_calib.h. */
+#define BEACON_TLV_ADV_INTERVAL 0xFE
+/** Heard-neighbors filter, see heard_filter.h. */
+#define BEACON_TLV_HEARD 0xFF
+
+/** @brief Publish a typed value in our beacons.
+ *
+ * Replaces the value of the same type, if there is one. The running advertising set carries the
+ * new value from its next advertising event on. Thread context only.
+ *
+ * @param[in] type Application-defined type.
+ * @param[in] value Value, copied.
+ * @param[in] len Length of the value.
+ *
+ * @retval 0 If the value was published.
+ * @retval -ENOSPC If the beacon has no room left, see CONFIG_BLEND_BEACON_DATA_MAX.
+ */
+int beacon_tlv_set(uint8_t type, const void *value, uint8_t len);
+
+/** @brief Stop publishing a typed value.
+ *
+ * @param[in] type Application-defined type.
+ *
+ * @retval 0 If the value was removed.
+ * @retval -ENOENT If no value of this type is published.
+ */
+int beacon_tlv_remove(uint8_t type);
+
+/** @brief Find a typed value in the application data of a received beacon.
+ *
+ * @param[in] data Application data, see scan_event_app_data().
+ * @param[in] len Length of the application data.
+ * @param[in] type Type to look for.
+ * @param[out] value Set to the start of the value within data.
+ *
+ * @return Length of the value, -ENOENT if the beacon carries no value of this type, or
+ *         -EBADMSG if the entries are malformed.
+ */
+int beacon_tlv_get(const uint8_t *data, size_t len, uint8_t type, const uint8_t **value);
+
+#endif
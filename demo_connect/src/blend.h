@@ -1,3 +1,5 @@
+#ifndef BLEND_CONN
+#define BLEND_CONN
 
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
@@ -10,7 +12,86 @@
 #include <bluetooth/scan.h>
 
 #include <dk_buttons_and_leds.h>
-void blend_init(int epoch_duration, int adv_interval);
+
+/** @brief BLEnd discovery modes. */
+enum blend_mode {
+	/** U-BLEnd: scan, then beacon until just past E/2. One-way discovery is guaranteed. */
+	BLEND_MODE_UNIDIRECTIONAL,
+	/** B-BLEnd: beacons on both sides of the scan, for same-epoch two-way discovery. */
+	BLEND_MODE_BIDIRECTIONAL,
+};
+
+/** @brief Timing statistics of the BLEnd epoch state machine.
+ *
+ * Lateness is measured from the absolute deadline of a transition to the moment
+ * its timer handler runs. Because every deadline is derived from the epoch grid,
+ * the epoch lateness is also the drift of that epoch and it never accumulates.
+ */
+struct blend_timing_stats {
+	uint32_t transitions;       /**< Number of phase transitions handled. */
+	uint32_t epochs;            /**< Number of epoch boundaries handled. */
+	uint32_t skipped_epochs;    /**< Epochs dropped because a boundary was more than one epoch late. */
+	uint32_t last_late_us;      /**< Lateness of the most recent transition. */
+	uint32_t max_late_us;       /**< Worst lateness of any transition. */
+	uint32_t max_epoch_late_us; /**< Worst lateness of an epoch start, i.e. the per-epoch drift bound. */
+	uint64_t sum_late_us;       /**< Sum of all lateness values, for the mean. */
+	uint32_t workq_count;       /**< Number of radio work items timed from submission. */
+	uint32_t workq_last_us;     /**< Queueing delay of the most recent radio work item. */
+	uint32_t workq_max_us;      /**< Worst queueing delay from timer expiry to handler start. */
+	uint64_t workq_sum_us;      /**< Sum of all queueing delays, for the mean. */
+	uint32_t maintenance_epochs; /**< Epochs run with a short scan around predicted beacons (sync mode). */
+	uint32_t sync_shifts;       /**< Times the grid was moved onto the sync leader's grid. */
+	uint32_t retunes;           /**< Parameter changes applied at an epoch boundary. */
+};
+
+/** @brief Radio profiles of the BLEnd beacons. */
+enum blend_phy {
+	/** Legacy advertising PDUs on LE 1M, heard by any scanner. */
+	BLEND_PHY_1M,
+	/** Extended advertising: a short ADV_EXT_IND on 1M, the payload on LE 2M. Shortest airtime. */
+	BLEND_PHY_2M,
+	/** Extended advertising on LE Coded (S=8) on both the primary and secondary channels, for range. */
+	BLEND_PHY_CODED,
+};
+
+/** @name Primary advertising channels, for blend_channels_set()
+ * @{
+ */
+#define BLEND_CHAN_37 BIT(0)
+#define BLEND_CHAN_38 BIT(1)
+#define BLEND_CHAN_39 BIT(2)
+#define BLEND_CHAN_ALL (BLEND_CHAN_37 | BLEND_CHAN_38 | BLEND_CHAN_39)
+/** @} */
+
+/** Longest random delay the Core specification allows between advertising events, in microseconds. */
+#define BLEND_ADV_DELAY_MAX_US 10000
+
+/** @brief Radio slack the epoch layout leaves around the advertising interval.
+ *
+ * The delay defaults to the worst case of 10 ms, the airtime follows from the radio profile.
+ */
+struct blend_margins {
+	uint32_t adv_delay_max_us;  /**< Longest random delay added to an advertising interval. */
+	uint32_t adv_delay_mean_us; /**< Mean random delay, for the number of beacons in a window. */
+	uint32_t airtime_us;        /**< Airtime of one advertising event on all of its channels. */
+};
+
+int blend_init(int epoch_duration, int adv_interval, enum blend_mode mode);
+int blend_retune(int epoch_duration, int adv_interval);
+int blend_phy_set(enum blend_phy phy);
+int blend_channels_set(uint8_t channels);
+int blend_margins_set(const struct blend_margins *margins);
+void blend_margins_get(struct blend_margins *margins);
 void blend_start(void);
 void blend_stop(void);
+uint32_t blend_epoch_get(void);
+void blend_timing_get(struct blend_timing_stats *stats);
+void blend_work_begin(void);
+void blend_radio_submit(struct k_work *work);
+
+
+
+
+
 
+#endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef BLEND_ADAPT_CONN
+#define BLEND_ADAPT_CONN
+
+#include <zephyr/kernel.h>
+
+#include "blend_opt.h"
+#include "neighbor.h"
+
+/** @brief Bounds the adaptive controller keeps E and A within. */
+struct blend_adapt_config {
+	/** Discovery target; its neighbors field is replaced by the observed density. */
+	struct blend_opt_target target;
+	/** Largest radio duty cycle the controller may pick, as a fraction. */
+	float max_duty_cycle;
+};
+
+/** @brief Adaptive controller state and counters. */
+struct blend_adapt_stats {
+	uint32_t retunes;      /**< Parameter changes requested. */
+	uint32_t rejected;     /**< Densities for which no pair met the target within the duty cycle bound. */
+	uint16_t neighbors;    /**< Density the current parameters were chosen for. */
+	uint16_t density_x16;  /**< Smoothed number of tracked neighbors, in 1/16. */
+	uint16_t miss_permille; /**< Smoothed fraction of tracked neighbors missed per epoch. */
+	uint32_t epoch_ms;     /**< Current epoch length. */
+	uint16_t adv_interval; /**< Current advertising interval in 0.625 ms units. */
+};
+
+/** @brief Start the adaptive controller.
+ *
+ * @param[in] config Target and energy bound.
+ * @param[in] initial Parameters BLEnd was initialized with.
+ * @param[in] neighbors Density the initial parameters were chosen for.
+ */
+void blend_adapt_init(const struct blend_adapt_config *config,
+		      const struct blend_opt_result *initial, uint16_t neighbors);
+
+/** @brief Feed one neighbor-set report to the controller.
+ *
+ * Call from the neighbor report callback. When the observed density or miss rate has moved far
+ * enough from what the current parameters were chosen for, new parameters are requested with
+ * blend_retune() and take effect at the next epoch boundary.
+ *
+ * @param[in] report Report of the epoch that has just ended.
+ */
+void blend_adapt_report(const struct neighbor_report *report);
+
+/** @brief Copy the controller state. */
+void blend_adapt_stats_get(struct blend_adapt_stats *stats);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef BLEND_CALIB_CONN
+#define BLEND_CALIB_CONN
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/addr.h>
+
+/** @brief Scan-slack calibration counters. */
+struct blend_calib_stats {
+	uint32_t samples;       /**< Beacon inter-arrival times used. */
+	uint32_t rejected;      /**< Inter-arrival times too far from one advertising interval. */
+	uint32_t delay_max_us;  /**< Longest random advertising delay observed. */
+	uint32_t delay_mean_us; /**< Mean random advertising delay observed. */
+	uint32_t applied;       /**< Times new margins were handed to BLEnd. */
+};
+
+/** @brief Publish our advertising interval for the calibration of our neighbors.
+ *
+ * Call whenever the controller takes a new interval. Thread context only.
+ *
+ * @param[in] adv_interval Advertising interval in 0.625 ms units.
+ *
+ * @retval 0 If the interval was published.
+ *           Otherwise, a (negative) error code is returned, see beacon_tlv_set().
+ */
+int blend_calib_publish(uint16_t adv_interval);
+
+/** @brief Feed the arrival of one BLEnd beacon to the calibration.
+ *
+ * Call from the scan callback with CONFIG_BLEND_CALIB. Two beacons of the same neighbor one
+ * advertising interval apart give one sample of its random advertising delay, measured against
+ * the interval the neighbor publishes with blend_calib_publish(). Once
+ * CONFIG_BLEND_CALIB_MIN_SAMPLES samples are in, the delay is handed to blend_margins_set()
+ * from the system workqueue, and again whenever a longer delay is observed.
+ *
+ * @param[in] addr Address of the sender.
+ * @param[in] cyc Cycle count at reception.
+ * @param[in] data Application data of the beacon.
+ * @param[in] len Length of the application data.
+ * @param[in] window_us Time the scanner stays on one channel.
+ */
+void blend_calib_beacon(const bt_addr_le_t *addr, uint32_t cyc, const uint8_t *data, size_t len,
+			uint32_t window_us);
+
+/** @brief Copy the calibration counters. */
+void blend_calib_stats_get(struct blend_calib_stats *stats);
+
+#endif
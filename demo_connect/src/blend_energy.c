@@ -0,0 +1,243 @@
+#include "blend_energy.h"
+#include "blend.h"
+
+#include <zephyr/shell/shell.h>
+#include <string.h>
+
+/* Radio energy accounting
+    * The time since the last radio event is added to the scan time while a scan window is open,
+    * to the advertising time while an advertising window is open, and to the idle time while
+    * neither is, so windows that overlap are counted in full in both. The charge of an epoch
+    * follows from the current model: the receiver is on for the whole scan window, the
+    * transmitter for the airtime of each beacon sent plus CONFIG_BLEND_ENERGY_EVENT_OVERHEAD_US,
+    * and the rest of the epoch draws the sleep current.
+*/
+static struct blend_energy_epoch cur;
+static struct blend_energy_stats totals;
+static bool running, scanning, advertising;
+static k_ticks_t last_change;
+
+/**
+ * @brief Adds the time since the last radio event to the running epoch, with interrupts locked
+ */
+static void energy_advance(void)
+{
+	k_ticks_t now = k_uptime_ticks();
+	uint32_t us = (uint32_t)k_ticks_to_us_floor64(now - last_change);
+
+	last_change = now;
+	if (!running) {
+		return;
+	}
+	cur.duration_us += us;
+	if (scanning) {
+		cur.scan_us += us;
+	}
+	if (advertising) {
+		cur.adv_us += us;
+	}
+	if (!scanning && !advertising) {
+		cur.idle_us += us;
+	}
+}
+
+/**
+ * @brief Returns the charge of an epoch under the current model
+ *
+ * @param e Epoch
+ *
+ * @return Charge in nanocoulombs.
+ */
+static uint32_t energy_charge_nc(const struct blend_energy_epoch *e)
+{
+	struct blend_margins m;
+	uint64_t tx_us, sleep_us, charge_pc;
+
+	blend_margins_get(&m);
+	tx_us = (uint64_t)e->beacons_sent * (m.airtime_us + CONFIG_BLEND_ENERGY_EVENT_OVERHEAD_US);
+	sleep_us = e->duration_us > e->scan_us + tx_us ? e->duration_us - e->scan_us - tx_us : 0;
+	// uA * us = pC
+	charge_pc = (uint64_t)e->scan_us * CONFIG_BLEND_ENERGY_RX_UA +
+		    tx_us * CONFIG_BLEND_ENERGY_TX_UA + sleep_us * CONFIG_BLEND_ENERGY_SLEEP_NA / 1000;
+	return (uint32_t)(charge_pc / 1000);
+}
+
+/**
+ * @brief Accounts the running epoch, with interrupts locked
+ */
+static void energy_close(void)
+{
+	if (!running) {
+		return;
+	}
+	energy_advance();
+	cur.charge_nc = energy_charge_nc(&cur);
+	totals.last = cur;
+	totals.epochs++;
+	totals.duration_us += cur.duration_us;
+	totals.scan_us += cur.scan_us;
+	totals.adv_us += cur.adv_us;
+	totals.idle_us += cur.idle_us;
+	totals.beacons_sent += cur.beacons_sent;
+	totals.packets_received += cur.packets_received;
+	totals.charge_nc += cur.charge_nc;
+}
+
+/**
+ * @brief Accounts the epoch that has just ended and starts the next one
+ *
+ * @param epoch Number of the epoch that starts
+ */
+void blend_energy_epoch(uint32_t epoch)
+{
+	unsigned int key = irq_lock();
+
+	energy_close();
+	memset(&cur, 0, sizeof(cur));
+	cur.epoch = epoch;
+	running = true;
+	last_change = k_uptime_ticks();
+	irq_unlock(key);
+}
+
+/**
+ * @brief Accounts the running epoch when BLEnd stops
+ */
+void blend_energy_stop(void)
+{
+	unsigned int key = irq_lock();
+
+	energy_close();
+	running = false;
+	irq_unlock(key);
+}
+
+/**
+ * @brief Sets the state of the scan and advertising windows
+ *
+ * @param scan New state of the scan window
+ * @param adv New state of the advertising window
+ * @param sent Advertising events to add to the running epoch
+ */
+static void energy_set(bool scan, bool adv, uint16_t sent)
+{
+	unsigned int key = irq_lock();
+
+	energy_advance();
+	scanning = scan;
+	advertising = adv;
+	cur.beacons_sent += sent;
+	irq_unlock(key);
+}
+
+void blend_energy_scan_on(void)
+{
+	energy_set(true, advertising, 0);
+}
+
+void blend_energy_scan_off(void)
+{
+	energy_set(false, advertising, 0);
+}
+
+void blend_energy_adv_on(void)
+{
+	energy_set(scanning, true, 0);
+}
+
+void blend_energy_adv_off(uint16_t sent)
+{
+	energy_set(scanning, false, sent);
+}
+
+void blend_energy_rx(void)
+{
+	unsigned int key = irq_lock();
+
+	cur.packets_received++;
+	irq_unlock(key);
+}
+
+/**
+ * @brief Copies the accounting and projects the battery life
+ *
+ * @param stats Destination for the accounting
+ */
+void blend_energy_get(struct blend_energy_stats *stats)
+{
+	unsigned int key = irq_lock();
+
+	*stats = totals;
+	irq_unlock(key);
+
+	// nC / us = mA
+	stats->avg_current_na = stats->duration_us ?
+		(uint32_t)(stats->charge_nc * 1000000 / stats->duration_us) : 0;
+	stats->battery_life_h = stats->avg_current_na ?
+		(uint32_t)(CONFIG_BLEND_ENERGY_BATTERY_MAH * 1000000ULL / stats->avg_current_na) : 0;
+}
+
+/**
+ * @brief Clears the accounting
+ */
+void blend_energy_reset(void)
+{
+	unsigned int key = irq_lock();
+	uint32_t epoch = cur.epoch;
+
+	memset(&totals, 0, sizeof(totals));
+	memset(&cur, 0, sizeof(cur));
+	cur.epoch = epoch;
+	last_change = k_uptime_ticks();
+	irq_unlock(key);
+}
+
+#if defined(CONFIG_BLEND_ENERGY_SHELL)
+
+static int cmd_energy(const struct shell *sh, size_t argc, char **argv)
+{
+	struct blend_energy_stats s;
+	const struct blend_energy_epoch *e = &s.last;
+
+	blend_energy_get(&s);
+	if (s.epochs == 0) {
+		shell_print(sh, "no epoch has ended yet");
+		return 0;
+	}
+	shell_print(sh, "epoch %u: %u ms, scan %u ms, advertise %u ms, idle %u ms", e->epoch,
+		    e->duration_us / 1000, e->scan_us / 1000, e->adv_us / 1000, e->idle_us / 1000);
+	shell_print(sh, "  %u beacons sent, %u received, %u uC", e->beacons_sent,
+		    e->packets_received, e->charge_nc / 1000);
+	shell_print(sh, "%u epochs: scan %u.%02u %%, advertise %u.%02u %% of the time", s.epochs,
+		    (uint32_t)(s.scan_us * 100 / s.duration_us),
+		    (uint32_t)(s.scan_us * 10000 / s.duration_us % 100),
+		    (uint32_t)(s.adv_us * 100 / s.duration_us),
+		    (uint32_t)(s.adv_us * 10000 / s.duration_us % 100));
+	shell_print(sh, "  %llu beacons sent, %llu received, %llu uC",
+		    (unsigned long long)s.beacons_sent, (unsigned long long)s.packets_received,
+		    (unsigned long long)(s.charge_nc / 1000));
+	shell_print(sh, "  mean current %u.%03u uA, battery life %u days on %u mAh",
+		    s.avg_current_na / 1000, s.avg_current_na % 1000, s.battery_life_h / 24,
+		    CONFIG_BLEND_ENERGY_BATTERY_MAH);
+	return 0;
+}
+
+static int cmd_energy_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	blend_energy_reset();
+	shell_print(sh, "energy accounting cleared");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(blend_energy_cmds,
+	SHELL_CMD(reset, NULL, "Clear the energy accounting", cmd_energy_reset),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(blend_cmds,
+	SHELL_CMD(energy, &blend_energy_cmds, "Radio time and charge of the last epoch and in total",
+		  cmd_energy),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(blend, &blend_cmds, "BLEnd commands", NULL);
+
+#endif
@@ -0,0 +1,220 @@
+#include "blend_group.h"
+#include "advertiser_scanner.h"
+
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(BLEnd_CONN_GROUP, LOG_LEVEL_DBG);
+
+/* Group channel
+    * The train carries one manufacturer data AD structure: the company ID, the group identifier
+    * and the application data. A sync is created from the system workqueue, since the scan
+    * callback runs in the Bluetooth RX context, and stays pending until the scanner catches the
+    * sync info of the source again; BLEnd only scans for part of each epoch, so a pending sync
+    * is given up after CONFIG_BLEND_GROUP_SYNC_TIMEOUT_MS and retried with the next beacon.
+*/
+#define GROUP_COMPANY_ID 0x0059
+#define GROUP_IDENTIFIER 0xFD
+#define GROUP_HDR_LEN 3		// company ID and group identifier
+#define GROUP_SYNC_LOST_EVENTS 6	// periodic events missed before the sync is lost
+#define GROUP_DELETE_RETRY_MS 100	// wait before retrying a sync that failed to delete
+
+enum group_state {
+	GROUP_IDLE,
+	GROUP_PENDING,	// sync created, not established yet
+	GROUP_SYNCED,
+	GROUP_SOURCE,	// feeding a train, not following one
+};
+
+static atomic_t state = ATOMIC_INIT(GROUP_IDLE);
+static struct bt_le_per_adv_sync *sync;
+/* train to sync to, written by the scan callback before the sync work runs */
+static bt_addr_le_t sync_addr;
+static uint8_t sync_sid;
+static uint16_t sync_interval;
+static uint8_t group_mfg[GROUP_HDR_LEN + CONFIG_BLEND_GROUP_DATA_MAX] = {
+	GROUP_COMPANY_ID & 0xff, GROUP_COMPANY_ID >> 8, GROUP_IDENTIFIER,
+};
+static blend_group_recv_cb_t recv_cb;
+static void *recv_user_data;
+
+static void group_sync_handler(struct k_work *work);
+static void group_timeout_handler(struct k_work *work);
+static void group_synced(struct bt_le_per_adv_sync *s, struct bt_le_per_adv_sync_synced_info *info);
+static void group_term(struct bt_le_per_adv_sync *s, const struct bt_le_per_adv_sync_term_info *info);
+static void group_recv(struct bt_le_per_adv_sync *s, const struct bt_le_per_adv_sync_recv_info *info,
+		       struct net_buf_simple *buf);
+
+K_WORK_DEFINE(group_sync_work, group_sync_handler);
+K_WORK_DELAYABLE_DEFINE(group_timeout_work, group_timeout_handler);
+
+static struct bt_le_per_adv_sync_cb group_sync_cb = {
+	.synced = group_synced,
+	.term = group_term,
+	.recv = group_recv,
+};
+
+/**
+ * @brief Creates the sync to the train whose sync info was heard last
+ *
+ * @param *work Work item of the sync
+ */
+static void group_sync_handler(struct k_work *work)
+{
+	// 1.25 ms interval units to 10 ms timeout units
+	uint32_t timeout = DIV_ROUND_UP((uint32_t)sync_interval * GROUP_SYNC_LOST_EVENTS, 8);
+	struct bt_le_per_adv_sync_param param = {
+		.sid = sync_sid,
+		.skip = 0,
+		.timeout = CLAMP(timeout, 0x000A, 0x4000),
+	};
+	static bool registered;
+	int err;
+
+	if (!registered) {
+		bt_le_per_adv_sync_cb_register(&group_sync_cb);
+		registered = true;
+	}
+	bt_addr_le_copy(&param.addr, &sync_addr);
+	err = bt_le_per_adv_sync_create(&param, &sync);
+	if (err) {
+		LOG_ERR("Periodic advertising sync failed to create (err %d)", err);
+		atomic_set(&state, GROUP_IDLE);
+		return;
+	}
+	k_work_schedule(&group_timeout_work, K_MSEC(CONFIG_BLEND_GROUP_SYNC_TIMEOUT_MS));
+}
+
+/**
+ * @brief Gives up a sync that was not established in time, retrying until the delete succeeds
+ *
+ * @param *work Work item of the timeout
+ */
+static void group_timeout_handler(struct k_work *work)
+{
+	int err;
+
+	if (atomic_get(&state) != GROUP_PENDING) {
+		return;
+	}
+	LOG_DBG("Sync to the group channel timed out");
+	err = bt_le_per_adv_sync_delete(sync);
+	if (err) {
+		// still pending, so no new sync is created over it; the term callback may idle it first
+		LOG_ERR("Periodic advertising sync failed to delete (err %d)", err);
+		k_work_schedule(&group_timeout_work, K_MSEC(GROUP_DELETE_RETRY_MS));
+		return;
+	}
+	atomic_cas(&state, GROUP_PENDING, GROUP_IDLE);
+}
+
+static void group_synced(struct bt_le_per_adv_sync *s, struct bt_le_per_adv_sync_synced_info *info)
+{
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	if (!atomic_cas(&state, GROUP_PENDING, GROUP_SYNCED)) {
+		return;
+	}
+	bt_addr_le_to_str(info->addr, addr, sizeof(addr));
+	LOG_INF("Synced to the group channel of %s, interval %u", addr, info->interval);
+}
+
+static void group_term(struct bt_le_per_adv_sync *s, const struct bt_le_per_adv_sync_term_info *info)
+{
+	LOG_INF("Group channel sync ended (reason 0x%02x)", info->reason);
+	atomic_cas(&state, GROUP_PENDING, GROUP_IDLE);
+	atomic_cas(&state, GROUP_SYNCED, GROUP_IDLE);
+}
+
+// finds the group data among the AD structures of the train
+static bool group_parse_cb(struct bt_data *data, void *user_data)
+{
+	const struct bt_le_per_adv_sync_recv_info *info = user_data;
+
+	if (data->type != BT_DATA_MANUFACTURER_DATA || data->data_len < GROUP_HDR_LEN ||
+	    memcmp(data->data, group_mfg, GROUP_HDR_LEN) != 0) {
+		return true;
+	}
+	if (recv_cb) {
+		recv_cb(info->addr, data->data + GROUP_HDR_LEN, data->data_len - GROUP_HDR_LEN,
+			recv_user_data);
+	}
+	return false;
+}
+
+static void group_recv(struct bt_le_per_adv_sync *s, const struct bt_le_per_adv_sync_recv_info *info,
+		       struct net_buf_simple *buf)
+{
+	bt_data_parse(buf, group_parse_cb, (void *)info);
+}
+
+void blend_group_beacon(const struct bt_le_scan_recv_info *info)
+{
+	if (!atomic_cas(&state, GROUP_IDLE, GROUP_PENDING)) {
+		return;
+	}
+	bt_addr_le_copy(&sync_addr, info->addr);
+	sync_sid = info->sid;
+	sync_interval = info->interval;
+	k_work_submit(&group_sync_work);
+}
+
+int blend_group_source_start(void)
+{
+	struct bt_data ad = BT_DATA(BT_DATA_MANUFACTURER_DATA, group_mfg, GROUP_HDR_LEN);
+	int err;
+
+	if (!atomic_cas(&state, GROUP_IDLE, GROUP_SOURCE)) {
+		return -EALREADY;
+	}
+	err = adv_periodic_start(CONFIG_BLEND_GROUP_INTERVAL_MS * 4 / 5, &ad, 1);
+	if (err) {
+		atomic_set(&state, GROUP_IDLE);
+	}
+	return err;
+}
+
+int blend_group_source_stop(void)
+{
+	int err;
+
+	if (atomic_get(&state) != GROUP_SOURCE) {
+		return -EALREADY;
+	}
+	err = adv_periodic_stop();
+	if (err) {
+		return err;
+	}
+	atomic_set(&state, GROUP_IDLE);
+	return 0;
+}
+
+int blend_group_send(const void *data, size_t len)
+{
+	struct bt_data ad;
+
+	if (len > CONFIG_BLEND_GROUP_DATA_MAX) {
+		return -EMSGSIZE;
+	}
+	memcpy(&group_mfg[GROUP_HDR_LEN], data, len);
+	ad = (struct bt_data)BT_DATA(BT_DATA_MANUFACTURER_DATA, group_mfg, GROUP_HDR_LEN + len);
+	return adv_periodic_data_set(&ad, 1);
+}
+
+void blend_group_recv_cb_register(blend_group_recv_cb_t cb, void *user_data)
+{
+	unsigned int key = irq_lock();
+
+	recv_cb = cb;
+	recv_user_data = user_data;
+	irq_unlock(key);
+}
+
+int blend_group_source_get(bt_addr_le_t *source)
+{
+	if (atomic_get(&state) != GROUP_SYNCED) {
+		return -ENOTCONN;
+	}
+	bt_addr_le_copy(source, &sync_addr);
+	return 0;
+}
@@ -0,0 +1,57 @@
+#include "blend_trace.h"
+
+#include <ctf_top.h>
+
+/* BLEnd trace points
+    * Each point is one CTF event in the stream of Zephyr's CTF tracing: the event header of the
+    * stream (timestamp and ID) followed by the fields in the order of blend.tsdl. CTF_EVENT copies
+    * the fields into a packet on the stack and hands it to the tracing backend, which buffers it
+    * and writes it out from its own thread. No string is formatted at the trace point.
+*/
+
+void blend_trace_epoch(uint32_t epoch, uint32_t late_us)
+{
+	CTF_EVENT(CTF_LITERAL(uint8_t, BLEND_TRACE_ID_EPOCH), epoch, late_us);
+}
+
+void blend_trace_scan_on(uint32_t duration_ms)
+{
+	CTF_EVENT(CTF_LITERAL(uint8_t, BLEND_TRACE_ID_SCAN_ON), duration_ms);
+}
+
+void blend_trace_scan_off(uint8_t reason)
+{
+	CTF_EVENT(CTF_LITERAL(uint8_t, BLEND_TRACE_ID_SCAN_OFF), reason);
+}
+
+void blend_trace_adv_on(uint16_t events, uint32_t duration_ms)
+{
+	CTF_EVENT(CTF_LITERAL(uint8_t, BLEND_TRACE_ID_ADV_ON), events, duration_ms);
+}
+
+void blend_trace_adv_off(uint16_t sent, uint8_t reason)
+{
+	CTF_EVENT(CTF_LITERAL(uint8_t, BLEND_TRACE_ID_ADV_OFF), sent, reason);
+}
+
+void blend_trace_match(const bt_addr_le_t *addr, int8_t rssi, bool connectable, bool is_new)
+{
+	bt_addr_le_t peer = *addr;
+	uint8_t flags = (connectable ? BIT(0) : 0) | (is_new ? BIT(1) : 0);
+
+	CTF_EVENT(CTF_LITERAL(uint8_t, BLEND_TRACE_ID_MATCH), peer, rssi, flags);
+}
+
+void blend_trace_connected(const bt_addr_le_t *addr, uint8_t role, uint8_t err)
+{
+	bt_addr_le_t peer = *addr;
+
+	CTF_EVENT(CTF_LITERAL(uint8_t, BLEND_TRACE_ID_CONNECTED), peer, role, err);
+}
+
+void blend_trace_disconnected(const bt_addr_le_t *addr, uint8_t reason)
+{
+	bt_addr_le_t peer = *addr;
+
+	CTF_EVENT(CTF_LITERAL(uint8_t, BLEND_TRACE_ID_DISCONNECTED), peer, reason);
+}
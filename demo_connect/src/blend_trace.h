@@ -0,0 +1,84 @@
+#ifndef BLEND_TRACE_CONN
+#define BLEND_TRACE_CONN
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/addr.h>
+
+/** @name CTF event IDs of the BLEnd trace points
+ *
+ * They share the stream of Zephyr's CTF tracing, above the IDs of the kernel events.
+ * tools/blend_trace/blend.tsdl declares them for the host decoder and must be kept in sync.
+ * @{
+ */
+#define BLEND_TRACE_ID_EPOCH 0xE0
+#define BLEND_TRACE_ID_SCAN_ON 0xE1
+#define BLEND_TRACE_ID_SCAN_OFF 0xE2
+#define BLEND_TRACE_ID_ADV_ON 0xE3
+#define BLEND_TRACE_ID_ADV_OFF 0xE4
+#define BLEND_TRACE_ID_MATCH 0xE5
+#define BLEND_TRACE_ID_CONNECTED 0xE6
+#define BLEND_TRACE_ID_DISCONNECTED 0xE7
+/** @} */
+
+/** @brief Why a scan or advertising window ended. */
+enum blend_trace_end {
+	BLEND_TRACE_END_TIMEOUT,   /**< The controller ended the window on its own. */
+	BLEND_TRACE_END_STOPPED,   /**< The host stopped the window. */
+	BLEND_TRACE_END_CONNECTED, /**< A peer connected to the advertising set. */
+};
+
+/* Trace points, for CONFIG_BLEND_TRACE. Each one writes a few bytes to the tracing backend with
+ * interrupts locked, so it can stand in for a log line in a timer handler. */
+
+/** @brief An epoch starts.
+ *
+ * @param[in] epoch Number of the epoch.
+ * @param[in] late_us Lateness of the timer handler against the epoch deadline.
+ */
+void blend_trace_epoch(uint32_t epoch, uint32_t late_us);
+
+/** @brief The scan window starts, for at most @p duration_ms. */
+void blend_trace_scan_on(uint32_t duration_ms);
+
+/** @brief The scan window ends, for a reason of enum blend_trace_end. */
+void blend_trace_scan_off(uint8_t reason);
+
+/** @brief The advertising window starts.
+ *
+ * @param[in] events Advertising events the controller sends before it stops, 0 for no limit.
+ * @param[in] duration_ms Upper bound on the window, 0 for no limit.
+ */
+void blend_trace_adv_on(uint16_t events, uint32_t duration_ms);
+
+/** @brief The advertising window ends.
+ *
+ * @param[in] sent Advertising events sent, 0 when unknown.
+ * @param[in] reason One of enum blend_trace_end.
+ */
+void blend_trace_adv_off(uint16_t sent, uint8_t reason);
+
+/** @brief A beacon passed the scan filter.
+ *
+ * @param[in] addr Address of the sender.
+ * @param[in] rssi RSSI of the beacon.
+ * @param[in] connectable true for a connectable beacon.
+ * @param[in] is_new true when the sender was not in the neighbor table.
+ */
+void blend_trace_match(const bt_addr_le_t *addr, int8_t rssi, bool connectable, bool is_new);
+
+/** @brief A connection was established or failed.
+ *
+ * @param[in] addr Address of the peer.
+ * @param[in] role BT_CONN_ROLE_CENTRAL or BT_CONN_ROLE_PERIPHERAL.
+ * @param[in] err HCI error code, 0 on success.
+ */
+void blend_trace_connected(const bt_addr_le_t *addr, uint8_t role, uint8_t err);
+
+/** @brief A connection ended.
+ *
+ * @param[in] addr Address of the peer.
+ * @param[in] reason HCI reason code.
+ */
+void blend_trace_disconnected(const bt_addr_le_t *addr, uint8_t reason);
+
+#endif
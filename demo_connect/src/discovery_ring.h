@@ -0,0 +1,71 @@
+#ifndef DISCOVERY_RING_CONN
+#define DISCOVERY_RING_CONN
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gap.h>
+
+/* discovery_event.mfg_data_off when the BLEnd data is not where our beacons put it */
+#define DISCOVERY_NO_MFG_DATA 0xFF
+
+/** @brief A BLEnd beacon heard by the scanner.
+ *
+ * Holds only what the receive path can copy in constant time; the consumer parses the payload.
+ */
+struct discovery_event {
+	bt_addr_le_t addr;     /**< Advertiser address. */
+	int8_t rssi;           /**< RSSI of the report in dBm. */
+	bool connectable;      /**< Report was connectable. */
+	bool is_new;           /**< First beacon from this neighbor since it entered the table. */
+	uint8_t mfg_data_off;  /**< Offset of the BLEnd manufacturer data, or DISCOVERY_NO_MFG_DATA. */
+	uint8_t data_len;      /**< Number of payload bytes in data. */
+	uint32_t epoch;        /**< BLEnd epoch the beacon was heard in. */
+	uint32_t timestamp;    /**< Uptime of the report in milliseconds. */
+	/** Copy of the advertising payload, extended payloads up to the beacon data capacity. */
+	uint8_t data[BT_GAP_ADV_MAX_ADV_DATA_LEN + CONFIG_BLEND_BEACON_DATA_MAX];
+};
+
+/** @brief Discovery ring counters. */
+struct discovery_ring_stats {
+	uint32_t pushed;     /**< Events written to the ring. */
+	uint32_t overflow;   /**< Events dropped because the ring was full. */
+	uint32_t high_water; /**< Largest number of events waiting in the ring. */
+	uint32_t pending;    /**< Events waiting in the ring now. */
+};
+
+/** @brief Add an event to the ring.
+ *
+ * Lock-free, must only be called by the single producer, the scan callback in the Bluetooth
+ * RX context. The event is dropped and counted when the ring is full.
+ *
+ * @param[in] event Event to copy into the ring.
+ *
+ * @retval 0 If the event was queued.
+ * @retval -ENOBUFS If the ring was full.
+ */
+int discovery_ring_put(const struct discovery_event *event);
+
+/** @brief Take the oldest event from the ring.
+ *
+ * Lock-free, must only be called by the single consumer thread.
+ *
+ * @param[out] event Copy of the event.
+ *
+ * @retval 0 If an event was taken.
+ * @retval -EAGAIN If the ring is empty.
+ */
+int discovery_ring_get(struct discovery_event *event);
+
+/** @brief Wait until the ring holds at least one event.
+ *
+ * @param[in] timeout How long to wait.
+ *
+ * @retval 0 If an event is waiting.
+ * @retval -EAGAIN If the wait timed out.
+ */
+int discovery_ring_wait(k_timeout_t timeout);
+
+/** @brief Copy the ring counters. */
+void discovery_ring_stats_get(struct discovery_ring_stats *stats);
+
+#endif
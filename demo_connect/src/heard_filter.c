@@ -0,0 +1,148 @@
+#include "heard_filter.h"
+#include "beacon_tlv.h"
+#include "neighbor.h"
+#include "advertiser_scanner.h"
+
+#include <string.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(BLEnd_CONN_HEARD, LOG_LEVEL_DBG);
+
+/* Heard-neighbors filter
+    * Each address sets HEARD_FILTER_HASHES bits, derived from one FNV-1a hash by double hashing.
+    * The bit positions are taken modulo the length of the filter at hand, so nodes with another
+    * CONFIG_BLEND_HEARD_FILTER_BYTES still read each other's filters.
+*/
+#define HEARD_FILTER_LEN CONFIG_BLEND_HEARD_FILTER_BYTES
+
+BUILD_ASSERT(HEARD_FILTER_LEN + BEACON_TLV_OVERHEAD <= ADV_APP_DATA_MAX,
+	     "CONFIG_BLEND_BEACON_DATA_MAX has no room for the heard-neighbors filter");
+
+struct heard_build {
+	uint8_t filter[HEARD_FILTER_LEN];
+	uint32_t epoch;
+	uint16_t count;
+};
+
+/* last published filter; the beacon is only rewritten when it changes */
+static uint8_t published[HEARD_FILTER_LEN];
+static bool published_valid;
+/* the address our beacons are sent from */
+static bt_addr_le_t self;
+static bool self_valid;
+
+// FNV-1a over the address type and value
+static uint32_t heard_hash(const bt_addr_le_t *addr)
+{
+	uint32_t h = 2166136261u;
+
+	h = (h ^ addr->type) * 16777619u;
+	for (int i = 0; i < sizeof(addr->a.val); i++) {
+		h = (h ^ addr->a.val[i]) * 16777619u;
+	}
+	return h;
+}
+
+// bit i of the address in a filter of bits bits
+static uint32_t heard_bit(uint32_t h, int i, uint32_t bits)
+{
+	// odd step, so the positions differ whenever bits is a power of two
+	return ((h & 0xffff) + i * ((h >> 16) | 1)) % bits;
+}
+
+void heard_filter_add(uint8_t *filter, size_t len, const bt_addr_le_t *addr)
+{
+	uint32_t h = heard_hash(addr);
+
+	for (int i = 0; i < HEARD_FILTER_HASHES; i++) {
+		uint32_t bit = heard_bit(h, i, len * 8);
+
+		filter[bit / 8] |= BIT(bit % 8);
+	}
+}
+
+bool heard_filter_test(const uint8_t *filter, size_t len, const bt_addr_le_t *addr)
+{
+	uint32_t h = heard_hash(addr);
+
+	if (len == 0) {
+		return false;
+	}
+	for (int i = 0; i < HEARD_FILTER_HASHES; i++) {
+		uint32_t bit = heard_bit(h, i, len * 8);
+
+		if (!(filter[bit / 8] & BIT(bit % 8))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void heard_build_add(const struct neighbor *n, void *user_data)
+{
+	struct heard_build *build = user_data;
+
+	if (build->epoch - n->last_epoch <= CONFIG_BLEND_HEARD_FILTER_EPOCHS) {
+		heard_filter_add(build->filter, sizeof(build->filter), &n->addr);
+		build->count++;
+	}
+}
+
+int heard_filter_publish(uint32_t epoch)
+{
+	struct heard_build build = { .epoch = epoch };
+	int err;
+
+	neighbor_foreach(heard_build_add, &build);
+	if (published_valid && memcmp(published, build.filter, sizeof(published)) == 0) {
+		return 0;
+	}
+	err = beacon_tlv_set(BEACON_TLV_HEARD, build.filter, sizeof(build.filter));
+	if (err) {
+		LOG_ERR("Heard-neighbors filter failed to publish (err %d)", err);
+		return err;
+	}
+	memcpy(published, build.filter, sizeof(published));
+	published_valid = true;
+	LOG_DBG("epoch %u: %u neighbors in the filter", epoch, build.count);
+	return 0;
+}
+
+void heard_filter_beacon(const bt_addr_le_t *addr, const uint8_t *data, size_t len)
+{
+	const uint8_t *filter;
+	int filter_len;
+
+	filter_len = beacon_tlv_get(data, len, BEACON_TLV_HEARD, &filter);
+	if (filter_len <= 0) {
+		return;
+	}
+	if (!self_valid) {
+		size_t count = 1;
+
+		bt_id_get(&self, &count);
+		self_valid = count > 0;
+	}
+	(void)neighbor_hears_us_set(addr, heard_filter_test(filter, filter_len, &self) ?
+				  NEIGHBOR_HEARS_US_YES : NEIGHBOR_HEARS_US_NO);
+}
+
+int heard_filter_mutual(const bt_addr_le_t *addr)
+{
+	struct neighbor n;
+	int err;
+
+	err = neighbor_lookup(addr, &n);
+	if (err) {
+		return err;
+	}
+	switch (n.hears_us) {
+	case NEIGHBOR_HEARS_US_YES:
+		return 1;
+	case NEIGHBOR_HEARS_US_NO:
+		return 0;
+	default:
+		return -ENODATA;
+	}
+}
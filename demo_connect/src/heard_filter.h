@@ -0,0 +1,76 @@
+#ifndef HEARD_FILTER_CONN
+#define HEARD_FILTER_CONN
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/addr.h>
+
+/* Heard-neighbors filter
+ *
+ * With CONFIG_BLEND_HEARD_FILTER every beacon carries a Bloom filter of the neighbors heard in
+ * the last CONFIG_BLEND_HEARD_FILTER_EPOCHS epochs, as the BEACON_TLV_HEARD entry. A node that
+ * finds its own address in a neighbor's filter knows the discovery is mutual without connecting.
+ * The filter has no false negatives. False positives, a node reported as heard that was not,
+ * grow with the number of neighbors: with the default 8 bytes about 5% at 10 neighbors and 23% at
+ * 20. Raise CONFIG_BLEND_HEARD_FILTER_BYTES for denser groups.
+ */
+
+/** Hash functions per address. */
+#define HEARD_FILTER_HASHES 3
+
+/** @brief Add an address to a filter.
+ *
+ * @param[in,out] filter Filter bits.
+ * @param[in] len Length of the filter in bytes.
+ * @param[in] addr Address to add.
+ */
+void heard_filter_add(uint8_t *filter, size_t len, const bt_addr_le_t *addr);
+
+/** @brief Test an address against a filter.
+ *
+ * @param[in] filter Filter bits.
+ * @param[in] len Length of the filter in bytes, the filter of a neighbor can differ from ours.
+ * @param[in] addr Address to test.
+ *
+ * @retval true If the address may be in the filter.
+ * @retval false If the address is certainly not in the filter.
+ */
+bool heard_filter_test(const uint8_t *filter, size_t len, const bt_addr_le_t *addr);
+
+/** @brief Rebuild our filter from the neighbor table and publish it in the beacon.
+ *
+ * Called by the neighbor table at every epoch boundary, from the system workqueue. The beacon
+ * is only rewritten when the filter changed.
+ *
+ * @param[in] epoch The epoch that has just started.
+ *
+ * @retval 0 If the filter is published.
+ * @retval -ENOSPC If the beacon has no room for it, see CONFIG_BLEND_BEACON_DATA_MAX.
+ */
+int heard_filter_publish(uint32_t epoch);
+
+/** @brief Check a received beacon for our address.
+ *
+ * Call from the scan callback with CONFIG_BLEND_HEARD_FILTER, after neighbor_update(). Records
+ * in the neighbor table whether the sender has heard us. Beacons without a filter change nothing.
+ *
+ * @param[in] addr Address of the sender.
+ * @param[in] data Application data of the beacon.
+ * @param[in] len Length of the application data.
+ */
+void heard_filter_beacon(const bt_addr_le_t *addr, const uint8_t *data, size_t len);
+
+/** @brief Whether a neighbor has heard us.
+ *
+ * Tells from the last beacon of the neighbor whether discovery is mutual, so a node only needs to
+ * connect or keep advertising to the neighbor when it is not.
+ *
+ * @param[in] addr Address of the neighbor.
+ *
+ * @retval 1 If the neighbor's last filter lists us, subject to the false positive rate.
+ * @retval 0 If the neighbor has not heard us in its last filter epochs.
+ * @retval -ENOENT If the neighbor is not in the table.
+ * @retval -ENODATA If the neighbor's beacons carry no filter.
+ */
+int heard_filter_mutual(const bt_addr_le_t *addr);
+
+#endif
@@ -18,9 +18,14 @@
 
 #include <dk_buttons_and_leds.h>
 #include "blend.h"
+#include "blend_opt.h"
+#include "blend_adapt.h"
 #include "advertiser_scanner.h"
+#include "neighbor.h"
+#include "beacon_tlv.h"
 #include "my_lbs.h"
 #include "my_lbs_client.h"
+#include "blend_trace.h"
 #include <bluetooth/gatt_dm.h>
 LOG_MODULE_REGISTER(BLEnd_CONN_MAIN, LOG_LEVEL_INF);
 
@@ -32,8 +37,21 @@ LOG_MODULE_REGISTER(BLEnd_CONN_MAIN, LOG_LEVEL_INF);
 /* Timer for BLEnd timming */
 #define EPOCH_DURATION 10000		// 10 seconds
 #define ADV_INTERVAL 800		// 0.625ms 500ms
+#define BLEND_MODE BLEND_MODE_UNIDIRECTIONAL	// or BLEND_MODE_BIDIRECTIONAL for B-BLEnd
+#define BLEND_PHY BLEND_PHY_1M	// BLEND_PHY_2M for shorter beacons, BLEND_PHY_CODED for range
+#define BLEND_CHANNELS BLEND_CHAN_ALL	// e.g. BLEND_CHAN_37 alone in dense deployments
+/* Discovery targets: E and A are picked by the BLEnd optimizer, the values above are the fallback */
+#define TARGET_LATENCY 30000		// 30 seconds
+#define TARGET_PROBABILITY 0.95f
+#define EXPECTED_NEIGHBORS 10
+/* E and A are retuned to the observed density, within this radio duty cycle */
+#define MAX_DUTY_CYCLE 0.10f
+/* Types of the values this demo publishes in its beacons */
+#define TLV_BUTTON_STATE 0x02
 
 static bool app_button_state;
+/* button state last read from a neighbor's beacon */
+static int remote_button_state = -1;
 static struct bt_conn *default_conn = NULL;
 static struct bt_my_lbs bt_my_lbs;
 static struct my_lbs_client bt_my_client;
@@ -53,9 +71,16 @@ static void button_changed(uint32_t button_state, uint32_t has_changed)
 {
 	if (has_changed & USER_BUTTON) {
 		uint32_t user_button_state = button_state & USER_BUTTON;
+		int err;
+
 		/*  Send indication on a button press */
 		my_lbs_send_button_state_indicate(user_button_state);
 		app_button_state = user_button_state ? true : false;
+		// every neighbor hears the state in the next beacons, without a connection
+		err = beacon_tlv_set(TLV_BUTTON_STATE, &app_button_state, sizeof(uint8_t));
+		if (err) {
+			LOG_ERR("Button state failed to publish (err %d)", err);
+		}
 	}
 }
 
@@ -121,6 +146,10 @@ static void on_connected(struct bt_conn *conn, uint8_t err)
 {
 	int err_dm;
 	struct bt_conn_info info = {0};
+	if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+		(void)bt_conn_get_info(conn, &info);
+		blend_trace_connected(bt_conn_get_dst(conn), info.role, err);
+	}
 	if (err) {
 		LOG_ERR("Connection failed (err %u)\n", err);
 		bt_conn_unref(default_conn);	// Always unref if connection fails
@@ -166,6 +195,9 @@ static void on_connected(struct bt_conn *conn, uint8_t err)
 static void on_disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	LOG_INF("Disconnected (reason %u)\n", reason);
+	if (IS_ENABLED(CONFIG_BLEND_TRACE)) {
+		blend_trace_disconnected(bt_conn_get_dst(conn), reason);
+	}
 
 	dk_set_led_off( CONN_LED_CENTRAL);
 	dk_set_led_off(CONN_LED_PERIPHERAL);
@@ -191,10 +223,46 @@ static int init_button(void)
 	return err;
 }
 
+/* Shows the button state a neighbor publishes in its beacons on the LED, like an indication */
+static void beacon_button_state(const struct discovery_event *event)
+{
+	const uint8_t *app, *value;
+	size_t app_len = scan_event_app_data(event, &app);
+
+	if (app_len == 0 || beacon_tlv_get(app, app_len, TLV_BUTTON_STATE, &value) != 1 ||
+	    *value == remote_button_state) {
+		return;
+	}
+	remote_button_state = *value;
+	LOG_INF("Button state in beacon: %s", remote_button_state ? "Pressed" : "Released");
+	if (remote_button_state) {
+		dk_set_led_on(CONN_LED_PERIPHERAL);
+	} else {
+		dk_set_led_off(CONN_LED_PERIPHERAL);
+	}
+}
+
+/* Called once per epoch with the neighbors that joined or left the set heard by this node */
+static void neighbor_report(const struct neighbor_report *report, void *user_data)
+{
+	LOG_INF("epoch %u: %u neighbors, %u added, %u removed", report->epoch, report->heard,
+		report->added_count, report->removed_count);
+	blend_adapt_report(report);
+}
+
 int main(void)
 {
 
 	int err;
+	struct blend_opt_target target = {
+		.latency_ms = TARGET_LATENCY,
+		.probability = TARGET_PROBABILITY,
+		.neighbors = EXPECTED_NEIGHBORS,
+		.bidirectional = (BLEND_MODE == BLEND_MODE_BIDIRECTIONAL),
+	};
+	struct blend_opt_result params;
+	struct blend_adapt_config adapt_config;
+	struct discovery_event event;
 	
 	LOG_INF("Uni-direct BLEnd: Connection + Service \n");
     
@@ -229,10 +297,57 @@ int main(void)
 	}
     
 	
+	// the optimizer models the beacons of the chosen radio profile and channels
+	target.radio.beacon_us = adv_event_airtime_us(BLEND_PHY, BLEND_CHANNELS);
+	target.radio.channels = POPCOUNT(BLEND_CHANNELS);
+	err = blend_opt_solve(&target, &params);
+	if (err) {
+		LOG_WRN("No BLEnd parameters meet the target (err %d), using defaults\n", err);
+		params.epoch_ms = EPOCH_DURATION;
+		params.adv_interval = ADV_INTERVAL;
+	} else {
+		LOG_INF("BLEnd optimizer: duty cycle %d.%02d %%\n", (int)(params.duty_cycle * 100),
+			(int)(params.duty_cycle * 10000) % 100);
+	}
+
 	scan_init();
-	adv_init(ADV_INTERVAL);
+	adv_init(params.adv_interval);
     
-	blend_init(EPOCH_DURATION, ADV_INTERVAL);
+	err = blend_phy_set(BLEND_PHY);
+	if (err) {
+		LOG_ERR("BLEnd PHY profile not supported (err %d)\n", err);
+		return -1;
+	}
+	err = blend_channels_set(BLEND_CHANNELS);
+	if (err) {
+		LOG_ERR("BLEnd channel map not supported (err %d)\n", err);
+		return -1;
+	}
+	err = blend_init(params.epoch_ms, params.adv_interval, BLEND_MODE);
+	if (err && (params.epoch_ms != EPOCH_DURATION || params.adv_interval != ADV_INTERVAL)) {
+		LOG_WRN("BLEnd rejected the solved parameters (err %d), using defaults\n", err);
+		params.epoch_ms = EPOCH_DURATION;
+		params.adv_interval = ADV_INTERVAL;
+		err = blend_init(params.epoch_ms, params.adv_interval, BLEND_MODE);
+	}
+	if (err) {
+		LOG_ERR("BLEnd init failed (err %d)\n", err);
+		return -1;
+	}
+	adapt_config.target = target;
+	adapt_config.max_duty_cycle = MAX_DUTY_CYCLE;
+	blend_adapt_init(&adapt_config, &params, EXPECTED_NEIGHBORS);
+	neighbor_report_cb_register(neighbor_report, NULL);
 	blend_start();
-	
+
+	// drain the discovery ring; only first sightings are logged
+	for (;;) {
+		(void)discovery_ring_wait(K_FOREVER);
+		while (discovery_ring_get(&event) == 0) {
+			if (event.is_new) {
+				scan_event_log(&event);
+			}
+			beacon_button_state(&event);
+		}
+	}
 }
\ No newline at end of file
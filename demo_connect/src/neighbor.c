@@ -0,0 +1,385 @@
+#include "neighbor.h"
+#include "heard_filter.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(BLEnd_CONN_NEIGHBOR, LOG_LEVEL_DBG);
+
+/* Neighbor table
+    * A statically allocated open-addressing hash table with linear probing. Every address lives
+    * within NEIGHBOR_PROBE_MAX slots of its home slot, so insertion and lookup touch a bounded
+    * number of slots no matter how full the table is. Deletion shifts the following entries back
+    * instead of leaving tombstones, which keeps that bound intact.
+    * Every entry also remembers whether it was part of the last neighbor-set report, so the
+    * report at each epoch boundary only carries the neighbors that joined or left the set.
+*/
+#define NEIGHBOR_TABLE_SIZE CONFIG_BLEND_NEIGHBOR_MAX
+#define NEIGHBOR_TABLE_MASK (NEIGHBOR_TABLE_SIZE - 1)
+#define NEIGHBOR_PROBE_MAX 8
+#define NEIGHBOR_RSSI_EWMA_SHIFT 3	// weight 1/8 for every new sample
+
+BUILD_ASSERT(IS_POWER_OF_TWO(NEIGHBOR_TABLE_SIZE), "CONFIG_BLEND_NEIGHBOR_MAX must be a power of two");
+BUILD_ASSERT(NEIGHBOR_TABLE_SIZE >= NEIGHBOR_PROBE_MAX, "neighbor table smaller than its probe window");
+
+struct neighbor_slot {
+	struct neighbor neighbor;
+	/* epoch of the sighting before last_epoch, so a neighbor heard again after the boundary
+	 * still counts for the epoch being reported */
+	uint32_t prev_epoch;
+	uint16_t home;
+	bool used;
+	bool reported;
+};
+
+static struct neighbor_slot table[NEIGHBOR_TABLE_SIZE];
+static struct neighbor_table_stats stats;
+static struct k_spinlock lock;
+
+/* Reported neighbors evicted from the table since the last report. Only neighbors of the last
+ * report are added, so it cannot hold more than the table. */
+static bt_addr_le_t evicted[NEIGHBOR_TABLE_SIZE];
+static uint16_t evicted_count;
+/* neighbors in the last report that are still in the table */
+static uint16_t reported_count;
+
+static bt_addr_le_t report_added[NEIGHBOR_TABLE_SIZE];
+static bt_addr_le_t report_removed[NEIGHBOR_TABLE_SIZE];
+static neighbor_report_cb_t report_cb;
+static void *report_user_data;
+/* first epoch not covered by a report yet, and the epoch the latest boundary started */
+static uint32_t report_epoch;
+static atomic_t boundary_epoch;
+
+static void neighbor_age_work_handler(struct k_work *work);
+
+K_WORK_DEFINE(neighbor_age_work, neighbor_age_work_handler);
+
+// FNV-1a over the address type and value
+static uint16_t neighbor_hash(const bt_addr_le_t *addr)
+{
+	uint32_t h = 2166136261u;
+
+	h = (h ^ addr->type) * 16777619u;
+	for (int i = 0; i < sizeof(addr->a.val); i++) {
+		h = (h ^ addr->a.val[i]) * 16777619u;
+	}
+	return (h ^ (h >> 16)) & NEIGHBOR_TABLE_MASK;
+}
+
+// Removes the entry in slot i and shifts the rest of its cluster back. Call with the lock held.
+static void neighbor_remove_slot(uint16_t i)
+{
+	uint16_t j = i;
+
+	table[i].used = false;
+	stats.count--;
+	for (;;) {
+		uint16_t home;
+
+		j = (j + 1) & NEIGHBOR_TABLE_MASK;
+		if (!table[j].used) {
+			return;
+		}
+		home = table[j].home;
+		// leave the entry where it is if its home lies cyclically in (i, j]
+		if (i <= j ? (home > i && home <= j) : (home > i || home <= j)) {
+			continue;
+		}
+		table[i] = table[j];
+		table[j].used = false;
+		i = j;
+	}
+}
+
+// Refines the window prediction with a beacon received at now. Call with the lock held.
+static void neighbor_schedule_update(struct neighbor *n, const struct neighbor_beacon *beacon,
+				     int64_t now, bool same_window)
+{
+	// the window started no later than its first beacon we heard and no earlier than the
+	// window length before its last one
+	if (!same_window) {
+		n->next_window_max = now + beacon->epoch_ms;
+	}
+	n->next_window_min = MIN(now - beacon->window_ms + beacon->epoch_ms, n->next_window_max);
+	n->schedule = *beacon;
+}
+
+int neighbor_update(const bt_addr_le_t *addr, int8_t rssi, uint32_t epoch, int64_t now,
+		    const struct neighbor_beacon *beacon)
+{
+	uint16_t home = neighbor_hash(addr);
+	uint16_t victim = home;
+	struct neighbor *n;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	for (int i = 0; i < NEIGHBOR_PROBE_MAX; i++) {
+		uint16_t slot = (home + i) & NEIGHBOR_TABLE_MASK;
+
+		if (!table[slot].used) {
+			victim = slot;
+			stats.count++;
+			goto insert;
+		}
+		n = &table[slot].neighbor;
+		if (bt_addr_le_eq(&n->addr, addr)) {
+			if (n->last_epoch != epoch) {
+				table[slot].prev_epoch = n->last_epoch;
+				n->last_epoch = epoch;
+				n->epoch_count++;
+			}
+			n->last_seen = now;
+			n->rssi_ewma += ((rssi * 16) - n->rssi_ewma) >> NEIGHBOR_RSSI_EWMA_SHIFT;
+			if (beacon) {
+				neighbor_schedule_update(n, beacon, now,
+							 n->schedule.epoch_ms != 0 &&
+							 n->schedule.epoch == beacon->epoch &&
+							 n->schedule.phase_ms == beacon->phase_ms);
+			}
+			k_spin_unlock(&lock, key);
+			return 0;
+		}
+		if (n->last_seen < table[victim].neighbor.last_seen) {
+			victim = slot;
+		}
+	}
+	// probe window full: replace its stalest neighbor
+	stats.evicted++;
+	if (table[victim].reported) {
+		if (evicted_count < NEIGHBOR_TABLE_SIZE) {
+			bt_addr_le_copy(&evicted[evicted_count++], &table[victim].neighbor.addr);
+		}
+		reported_count--;
+	}
+
+insert:
+	n = &table[victim].neighbor;
+	bt_addr_le_copy(&n->addr, addr);
+	n->first_seen = now;
+	n->last_seen = now;
+	n->epoch_count = 1;
+	n->last_epoch = epoch;
+	n->rssi_ewma = rssi * 16;
+	n->schedule = (struct neighbor_beacon){0};
+	n->hears_us = NEIGHBOR_HEARS_US_UNKNOWN;
+	if (beacon) {
+		neighbor_schedule_update(n, beacon, now, false);
+	}
+	table[victim].prev_epoch = epoch;
+	table[victim].home = home;
+	table[victim].used = true;
+	table[victim].reported = false;
+	k_spin_unlock(&lock, key);
+	return 1;
+}
+
+int neighbor_hears_us_set(const bt_addr_le_t *addr, enum neighbor_hears_us hears_us)
+{
+	uint16_t home = neighbor_hash(addr);
+	int err = -ENOENT;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	for (int i = 0; i < NEIGHBOR_PROBE_MAX; i++) {
+		uint16_t slot = (home + i) & NEIGHBOR_TABLE_MASK;
+
+		if (!table[slot].used) {
+			break;
+		}
+		if (bt_addr_le_eq(&table[slot].neighbor.addr, addr)) {
+			table[slot].neighbor.hears_us = hears_us;
+			err = 0;
+			break;
+		}
+	}
+	k_spin_unlock(&lock, key);
+	return err;
+}
+
+int neighbor_lookup(const bt_addr_le_t *addr, struct neighbor *neighbor)
+{
+	uint16_t home = neighbor_hash(addr);
+	int err = -ENOENT;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	for (int i = 0; i < NEIGHBOR_PROBE_MAX; i++) {
+		uint16_t slot = (home + i) & NEIGHBOR_TABLE_MASK;
+
+		if (!table[slot].used) {
+			break;
+		}
+		if (bt_addr_le_eq(&table[slot].neighbor.addr, addr)) {
+			*neighbor = table[slot].neighbor;
+			err = 0;
+			break;
+		}
+	}
+	k_spin_unlock(&lock, key);
+	return err;
+}
+
+int neighbor_next_window(const bt_addr_le_t *addr, int64_t now, int64_t *start, int64_t *end)
+{
+	struct neighbor n;
+	int64_t periods;
+	int err;
+
+	err = neighbor_lookup(addr, &n);
+	if (err) {
+		return err;
+	}
+	if (n.schedule.epoch_ms == 0) {
+		return -ENODATA;
+	}
+	*start = n.next_window_min;
+	*end = n.next_window_max + n.schedule.window_ms;
+	if (*end < now) {
+		// skip the windows that have already ended
+		periods = (now - *end + n.schedule.epoch_ms - 1) / n.schedule.epoch_ms;
+		*start += periods * n.schedule.epoch_ms;
+		*end += periods * n.schedule.epoch_ms;
+	}
+	return 0;
+}
+
+void neighbor_foreach(neighbor_cb_t cb, void *user_data)
+{
+	for (int i = 0; i < NEIGHBOR_TABLE_SIZE; i++) {
+		struct neighbor copy;
+		bool used;
+		k_spinlock_key_t key = k_spin_lock(&lock);
+
+		used = table[i].used;
+		if (used) {
+			copy = table[i].neighbor;
+		}
+		k_spin_unlock(&lock, key);
+		if (used) {
+			cb(&copy, user_data);
+		}
+	}
+}
+
+int neighbor_count(void)
+{
+	return stats.count;
+}
+
+void neighbor_stats_get(struct neighbor_table_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = stats;
+	k_spin_unlock(&lock, key);
+}
+
+void neighbor_clear(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	for (int i = 0; i < NEIGHBOR_TABLE_SIZE; i++) {
+		// the next report still tells the application that these neighbors are gone
+		if (table[i].used && table[i].reported && evicted_count < NEIGHBOR_TABLE_SIZE) {
+			bt_addr_le_copy(&evicted[evicted_count++], &table[i].neighbor.addr);
+		}
+		table[i].reported = false;
+		table[i].used = false;
+	}
+	stats.count = 0;
+	reported_count = 0;
+	k_spin_unlock(&lock, key);
+}
+
+void neighbor_report_cb_register(neighbor_report_cb_t cb, void *user_data)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	report_cb = cb;
+	report_user_data = user_data;
+	k_spin_unlock(&lock, key);
+}
+
+// true when epoch lies in [from, from + count), modulo the counter wrap
+static bool epoch_in_range(uint32_t epoch, uint32_t from, uint32_t count)
+{
+	return epoch - from < count;
+}
+
+/**
+ * @brief Removes the silent neighbors and publishes the neighbor-set report of the last epoch
+ *
+ * The lock is taken per slot so the Bluetooth RX context is never held off for a whole sweep.
+ * A removal can shift an entry the sweep has already passed into a later slot; the report
+ * flags make visiting it twice harmless, and the heard count is taken from them at the end.
+ *
+ * @param *work Work item of the sweep
+ */
+static void neighbor_age_work_handler(struct k_work *work)
+{
+	int64_t oldest = k_uptime_get() - CONFIG_BLEND_NEIGHBOR_MAX_AGE_MS;
+	uint32_t to = (uint32_t)atomic_get(&boundary_epoch);
+	struct neighbor_report report = {
+		.epoch = report_epoch,
+		.epochs = to - report_epoch,
+		.added = report_added,
+		.removed = report_removed,
+	};
+	neighbor_report_cb_t cb;
+	void *user_data;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	memcpy(report_removed, evicted, evicted_count * sizeof(evicted[0]));
+	report.removed_count = evicted_count;
+	evicted_count = 0;
+	k_spin_unlock(&lock, key);
+
+	for (int i = 0; i < NEIGHBOR_TABLE_SIZE; i++) {
+		struct neighbor_slot *slot = &table[i];
+		bool heard;
+
+		key = k_spin_lock(&lock);
+		// a removal may shift another stale entry into this slot, so check it again
+		while (slot->used && slot->neighbor.last_seen < oldest) {
+			if (slot->reported) {
+				if (report.removed_count < NEIGHBOR_TABLE_SIZE) {
+					bt_addr_le_copy(&report_removed[report.removed_count++], &slot->neighbor.addr);
+				}
+				reported_count--;
+			}
+			neighbor_remove_slot(i);
+			stats.aged++;
+		}
+		if (slot->used) {
+			heard = epoch_in_range(slot->neighbor.last_epoch, report.epoch, report.epochs) ||
+				epoch_in_range(slot->prev_epoch, report.epoch, report.epochs);
+			if (heard && !slot->reported && report.added_count < NEIGHBOR_TABLE_SIZE) {
+				bt_addr_le_copy(&report_added[report.added_count++], &slot->neighbor.addr);
+				slot->reported = true;
+				reported_count++;
+			} else if (!heard && slot->reported && report.removed_count < NEIGHBOR_TABLE_SIZE) {
+				bt_addr_le_copy(&report_removed[report.removed_count++], &slot->neighbor.addr);
+				slot->reported = false;
+				reported_count--;
+			}
+		}
+		k_spin_unlock(&lock, key);
+	}
+	key = k_spin_lock(&lock);
+	report.heard = reported_count;
+	cb = report_cb;
+	user_data = report_user_data;
+	k_spin_unlock(&lock, key);
+	report_epoch = to;
+	LOG_DBG("%u neighbors, %u aged out, %u evicted", stats.count, stats.aged, stats.evicted);
+
+	if (IS_ENABLED(CONFIG_BLEND_HEARD_FILTER)) {
+		(void)heard_filter_publish(to);
+	}
+	if (cb) {
+		cb(&report, user_data);
+	}
+}
+
+void neighbor_epoch_boundary(uint32_t epoch)
+{
+	atomic_set(&boundary_epoch, epoch);
+	k_work_submit(&neighbor_age_work);
+}
@@ -0,0 +1,175 @@
+#include <errno.h>
+
+#include "blend_opt.h"
+
+/* advertising interval step of the search, in 0.625 ms units (5 ms) */
+#define ADV_INTERVAL_STEP 8
+/* B-BLEnd guard before the next epoch and scan overlap, as in blend.c */
+#define TRAIL_GUARD_MS 2
+#define SCAN_OVERLAP_MS 10
+
+// x^n by squaring, so the model needs no libm on target
+static float powi(float x, uint32_t n)
+{
+	float r = 1.0f;
+
+	while (n) {
+		if (n & 1) {
+			r *= x;
+		}
+		x *= x;
+		n >>= 1;
+	}
+	return r;
+}
+
+// smallest whole number of milliseconds not below ms
+static uint32_t ceil_ms(float ms)
+{
+	uint32_t whole = (uint32_t)ms;
+
+	return whole + ((float)whole < ms);
+}
+
+// beacon duration and slack in milliseconds, with the defaults for fields left at zero
+static void radio_ms(const struct blend_opt_radio *radio, float *beacon_ms, float *slack_ms)
+{
+	*beacon_ms = radio && radio->beacon_us ? radio->beacon_us / 1000.0f : BLEND_OPT_BEACON_MS;
+	*slack_ms = radio && radio->slack_us ? radio->slack_us / 1000.0f : BLEND_OPT_SLACK_MS;
+}
+
+int blend_opt_layout(uint32_t epoch_ms, uint16_t adv_interval, bool bidirectional,
+		     const struct blend_opt_radio *radio, struct blend_opt_layout *layout)
+{
+	// blend_layout_compute with the slack as the longest delay and half of it as the mean: a scan
+	// of one interval, the longest delay and one beacon per scanned channel in whole milliseconds,
+	// then beacons at the mean interval until just past E/2
+	float interval_ms = adv_interval * 0.625f;
+	uint32_t channels = radio && radio->channels ? radio->channels : 3;
+	float beacon_ms, slack_ms, avg_interval_ms;
+	uint32_t adv_interval_count, phase_ms;
+
+	if (adv_interval == 0 || epoch_ms == 0 || epoch_ms > BLEND_OPT_EPOCH_MAX_MS || channels > 3) {
+		return -EINVAL;
+	}
+	radio_ms(radio, &beacon_ms, &slack_ms);
+	avg_interval_ms = interval_ms + slack_ms / 2;
+	if (bidirectional) {
+		// blend_layout_compute: a lead beacon as the scan opens, a scan window longer by the
+		// guard and the 10 ms timeout unit, then beacons until the guard before the next epoch.
+		// The scan runs on for SCAN_OVERLAP_MS under them.
+		uint32_t channel_ms = ceil_ms(interval_ms + slack_ms + beacon_ms) + TRAIL_GUARD_MS + 10;
+		uint32_t scan_ms = (4 - channels) * channel_ms;
+
+		phase_ms = (scan_ms + 9) / 10 * 10;
+
+		// the beacons must be on every channel the scan visits, so one channel does not do
+		if (channels == 1 || phase_ms + TRAIL_GUARD_MS >= epoch_ms) {
+			return -EINVAL;
+		}
+		layout->lead_ms = ceil_ms(beacon_ms);
+		layout->scan_ms = phase_ms + SCAN_OVERLAP_MS;
+		layout->adv_ms = (epoch_ms - phase_ms - TRAIL_GUARD_MS) / 10 * 10;
+		layout->beacons = 1 + (uint32_t)(layout->adv_ms / avg_interval_ms) + 1;
+		return layout->adv_ms < scan_ms ? -EINVAL : 0;
+	}
+	layout->scan_ms = (4 - channels) * ceil_ms(interval_ms + slack_ms + beacon_ms);
+	if (layout->scan_ms >= epoch_ms / 2) {
+		return -EINVAL;
+	}
+	// plus one incomplete interval, and a beacon at the start of every interval and one at the end
+	adv_interval_count = (uint32_t)((epoch_ms / 2 - layout->scan_ms) / avg_interval_ms) + 1;
+	layout->adv_ms = ceil_ms(adv_interval_count * (interval_ms + slack_ms) + beacon_ms);
+	layout->lead_ms = 0;
+	layout->beacons = adv_interval_count + 1;
+	phase_ms = (layout->scan_ms + 9) / 10 * 10;
+	if (phase_ms + layout->adv_ms >= epoch_ms) {
+		return -EINVAL;
+	}
+	return 0;
+}
+
+float blend_opt_duty_cycle(uint32_t epoch_ms, uint16_t adv_interval, bool bidirectional,
+			   const struct blend_opt_radio *radio)
+{
+	struct blend_opt_layout layout;
+	float beacon_ms, slack_ms;
+
+	if (blend_opt_layout(epoch_ms, adv_interval, bidirectional, radio, &layout)) {
+		return -1.0f;
+	}
+	radio_ms(radio, &beacon_ms, &slack_ms);
+	return (layout.scan_ms + layout.beacons * beacon_ms) / epoch_ms;
+}
+
+float blend_opt_probability(uint32_t epoch_ms, uint16_t adv_interval, bool bidirectional,
+			    uint16_t neighbors, uint32_t latency_ms, const struct blend_opt_radio *radio)
+{
+	struct blend_opt_layout layout;
+	uint32_t epochs = latency_ms / epoch_ms;
+	float interval_ms = adv_interval * 0.625f;
+	float active, collision, p, beacon_ms, slack_ms;
+
+	if (epochs == 0 || blend_opt_layout(epoch_ms, adv_interval, bidirectional, radio, &layout)) {
+		return 0.0f;
+	}
+	radio_ms(radio, &beacon_ms, &slack_ms);
+	// fraction of its epoch another node spends beaconing
+	active = (float)(layout.lead_ms + layout.adv_ms) / epoch_ms;
+	collision = active * 2 * beacon_ms / interval_ms;
+	if (collision > 1.0f) {
+		collision = 1.0f;
+	}
+	p = powi(1.0f - collision, neighbors > 1 ? neighbors - 1 : 0);
+	return 1.0f - powi(1.0f - p, epochs);
+}
+
+int blend_opt_solve(const struct blend_opt_target *target, struct blend_opt_result *result)
+{
+	const struct blend_opt_radio *radio = &target->radio;
+	float beacon_ms, slack_ms;
+	bool found = false;
+
+	if (target->latency_ms == 0 || target->neighbors == 0 ||
+	    target->probability <= 0.0f || target->probability >= 1.0f || target->radio.channels > 3) {
+		return -EINVAL;
+	}
+
+	radio_ms(radio, &beacon_ms, &slack_ms);
+	// For a fixed number of epochs k inside the latency bound, the longest epoch E = latency/k
+	// has the lowest duty cycle, so only those epoch lengths need to be tried. Epochs longer
+	// than BLEND_OPT_EPOCH_MAX_MS are cut to it, which the first k tried covers.
+	for (uint32_t a = BLEND_OPT_ADV_INTERVAL_MIN; a <= BLEND_OPT_ADV_INTERVAL_MAX;
+	     a += ADV_INTERVAL_STEP) {
+		uint32_t min_epoch_ms = 2 * (a * 0.625f + slack_ms + beacon_ms);
+		uint32_t k_first = target->latency_ms / BLEND_OPT_EPOCH_MAX_MS;
+
+		for (uint32_t k = k_first ? k_first : 1; target->latency_ms / k >= min_epoch_ms; k++) {
+			uint32_t e = target->latency_ms / k;
+			float p, duty;
+
+			if (e > BLEND_OPT_EPOCH_MAX_MS) {
+				e = BLEND_OPT_EPOCH_MAX_MS;
+			}
+			p = blend_opt_probability(e, a, target->bidirectional, target->neighbors,
+						  target->latency_ms, radio);
+			if (p < target->probability) {
+				continue;
+			}
+			duty = blend_opt_duty_cycle(e, a, target->bidirectional, radio);
+			if (duty < 0.0f) {
+				continue;
+			}
+			if (!found || duty < result->duty_cycle) {
+				result->epoch_ms = e;
+				result->adv_interval = a;
+				result->duty_cycle = duty;
+				result->probability = p;
+				found = true;
+			}
+			// longer k only shortens E and raises the duty cycle once the target is met
+			break;
+		}
+	}
+	return found ? 0 : -ENOENT;
+}
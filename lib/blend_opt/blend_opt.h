@@ -0,0 +1,133 @@
+#ifndef BLEND_OPT_H_
+#define BLEND_OPT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * BLEnd parameter optimizer
+ *
+ * Picks the epoch length E and advertising interval A with the lowest radio duty cycle that still
+ * discovers a neighbor within a target latency with a target probability. The library has no
+ * Zephyr dependencies, so the firmware and the host CLI in tools/blend_opt share the same model.
+ *
+ * Collision model: the listener's scan window of A+b+s always contains one beacon of the
+ * neighbor. That beacon is lost if any of the other n-1 nodes starts a beacon within b of it.
+ * A node is beaconing for a fraction f of its epoch and sends one beacon every A, so the beacon
+ * survives with p = (1 - f*2b/A)^(n-1). Over the k = floor(latency/E) epochs that fit in the
+ * latency budget, the neighbor is discovered with P = 1 - (1 - p)^k.
+ *
+ * Beacons sent on a subset of k primary channels only collide while their shorter events overlap,
+ * which b already captures, but the scan has to visit the channels one after the other: 4 - k
+ * windows of A+b+s in a row contain at least one advertised channel. B-BLEnd needs beacons on every
+ * channel the scan visits, so two channels are taken to be 37 and 38, and one is rejected.
+ */
+
+/** Beacon duration b in milliseconds, the worst case for legacy advertising on 1M. */
+#define BLEND_OPT_BEACON_MS 5
+/** Maximum random advertising delay s in milliseconds. */
+#define BLEND_OPT_SLACK_MS 10
+/** Longest epoch E in milliseconds, since the beacons carry it in 16 bits. */
+#define BLEND_OPT_EPOCH_MAX_MS UINT16_MAX
+/** Smallest advertising interval considered, in 0.625 ms units (20 ms). */
+#define BLEND_OPT_ADV_INTERVAL_MIN 32
+/** Largest advertising interval considered, in 0.625 ms units (10.24 s). */
+#define BLEND_OPT_ADV_INTERVAL_MAX 16384
+
+/** @brief Radio timing the model is evaluated with.
+ *
+ * Fields left at zero select BLEND_OPT_BEACON_MS, BLEND_OPT_SLACK_MS and all three channels.
+ */
+struct blend_opt_radio {
+	/** Beacon duration b: one advertising event on all of its channels, in microseconds. */
+	uint32_t beacon_us;
+	/** Maximum random advertising delay s in microseconds. */
+	uint32_t slack_us;
+	/** Number of primary advertising channels the beacons are sent on, 1 to 3. */
+	uint8_t channels;
+};
+
+/** @brief Discovery requirements handed to the optimizer. */
+struct blend_opt_target {
+	/** Discovery latency bound in milliseconds. */
+	uint32_t latency_ms;
+	/** Probability of discovering a neighbor within the latency bound, in (0, 1). */
+	float probability;
+	/** Expected number of nodes in range, including the one being discovered. */
+	uint16_t neighbors;
+	/** Lay the epochs out for B-BLEnd, which beacons for the whole epoch outside the scan. */
+	bool bidirectional;
+	/** Radio timing of the advertising profile, zero for the defaults. */
+	struct blend_opt_radio radio;
+};
+
+/** @brief Parameters chosen by the optimizer. */
+struct blend_opt_result {
+	/** Epoch length E in milliseconds. */
+	uint32_t epoch_ms;
+	/** Advertising interval A in 0.625 ms units, as taken by blend_init. */
+	uint16_t adv_interval;
+	/** Fraction of time the radio is scanning or transmitting. */
+	float duty_cycle;
+	/** Discovery probability within the latency bound. */
+	float probability;
+};
+
+/** @brief Scan and advertising durations of one epoch, as laid out by blend_init. */
+struct blend_opt_layout {
+	uint32_t lead_ms; /**< Lead beacon as the scan opens, B-BLEnd only. */
+	uint32_t scan_ms; /**< Scan of one A+b+s window per channel to visit, as run in B-BLEnd. */
+	uint32_t adv_ms;  /**< Beacons after the scan. */
+	uint32_t beacons; /**< Beacons sent per epoch. */
+};
+
+/** @brief Compute the epoch layout for a parameter pair.
+ *
+ * @param[in] epoch_ms Epoch length in milliseconds.
+ * @param[in] adv_interval Advertising interval in 0.625 ms units.
+ * @param[in] bidirectional Lay the epoch out for B-BLEnd.
+ * @param[in] radio Radio timing, NULL for the defaults.
+ * @param[out] layout Durations of the epoch phases.
+ *
+ * @retval 0 If the active period fits in the epoch.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int blend_opt_layout(uint32_t epoch_ms, uint16_t adv_interval, bool bidirectional,
+		     const struct blend_opt_radio *radio, struct blend_opt_layout *layout);
+
+/** @brief Radio duty cycle of a parameter pair.
+ *
+ * @param[in] radio Radio timing, NULL for the defaults.
+ *
+ * @return Fraction of the epoch spent scanning or transmitting, or a negative value
+ *         if the parameters are not a valid BLEnd layout.
+ */
+float blend_opt_duty_cycle(uint32_t epoch_ms, uint16_t adv_interval, bool bidirectional,
+			   const struct blend_opt_radio *radio);
+
+/** @brief Probability of discovering a neighbor within a latency bound.
+ *
+ * @param[in] epoch_ms Epoch length in milliseconds.
+ * @param[in] adv_interval Advertising interval in 0.625 ms units.
+ * @param[in] bidirectional Evaluate the B-BLEnd layout, which beacons for longer.
+ * @param[in] neighbors Number of nodes in range, including the one being discovered.
+ * @param[in] latency_ms Latency bound in milliseconds.
+ * @param[in] radio Radio timing, NULL for the defaults.
+ *
+ * @return Discovery probability, 0 if not a single epoch fits in the latency bound.
+ */
+float blend_opt_probability(uint32_t epoch_ms, uint16_t adv_interval, bool bidirectional,
+			    uint16_t neighbors, uint32_t latency_ms, const struct blend_opt_radio *radio);
+
+/** @brief Find the (E, A) pair with the lowest duty cycle meeting a target.
+ *
+ * @param[in] target Discovery requirements.
+ * @param[out] result Chosen parameters.
+ *
+ * @retval 0 If a parameter pair was found.
+ * @retval -EINVAL If the target is malformed.
+ * @retval -ENOENT If no parameter pair with E up to BLEND_OPT_EPOCH_MAX_MS meets the target.
+ */
+int blend_opt_solve(const struct blend_opt_target *target, struct blend_opt_result *result);
+
+#endif
@@ -0,0 +1,305 @@
+#!/usr/bin/env python3
+"""
+blend_bsim: BabbleSim regression runs of the demo and demo_connect apps
+
+usage: blend_bsim.py [--build] [--apps demo demo_connect] [--devices 2 8 32]
+                     [--sim-length <s>] [--start-spread <ms>] [--seed <n>]
+                     [--baseline <json>] [--tolerance <fraction>] [--update-baseline]
+                     [--logs-only]
+
+Runs every app on nrf52_bsim with each number of devices, all in range of each other,
+and reads the discovery and connection events back from the device logs:
+
+- demo: the discovery latency of every pair of devices, from the time both were up to the
+  first "New neighbor" line of either, as percentiles, and the share of pairs discovered;
+- demo_connect: the connection setup time, from the central's first sighting of the peer to
+  its "Connected" line, and the share of devices that got connected.
+
+Each result is checked against the baseline. A run fails, and the script exits with 1, when a
+latency is more than --tolerance above its baseline or a share drops below it. A latency the run
+never reached is recorded as null; it only fails against a baseline that did reach it. Runs with
+the same seed are deterministic, so the bounds are tight. --update-baseline records the results as the new
+baseline, together with the BabbleSim, Zephyr and nRF Connect SDK versions and the run settings.
+A scenario without a recorded baseline, or one recorded with other settings, is an error.
+
+BSIM_OUT_PATH must point to a BabbleSim build with the 2G4 phy, as for the Zephyr bsim tests.
+"""
+
+import argparse
+import json
+import math
+import os
+import random
+import re
+import subprocess
+import sys
+from pathlib import Path
+
+REPO = Path(__file__).resolve().parents[2]
+DEFAULT_BASELINE = Path(__file__).resolve().parent / "baseline.json"
+BOARD = "nrf52_bsim"
+# a share may drop this many percentage points below the baseline
+SHARE_TOLERANCE_PCT = 0.0
+# run settings a baseline only holds for
+SETTINGS = ("sim_length", "start_spread", "seed")
+
+# "d_03: @00:01:02.345678  <line>", the prefix BabbleSim puts on the console of a device
+LINE_RE = re.compile(r"^d_(\d+): @(\d+):(\d+):(\d+)\.(\d+)\s+(.*)$")
+IDENTITY_RE = re.compile(r"Identity(?:\[\d+\])?: (\S+ \(\w+\))")
+READY_RE = re.compile(r"Bluetooth initialized")
+NEIGHBOR_RE = re.compile(r"New neighbor (\S+ \(\w+\))")
+CENTRAL_RE = re.compile(r"Connected: BT_CONN_ROLE_CENTRAL")
+PERIPHERAL_RE = re.compile(r"Connected: BT_CONN_ROLE_PERIPHERAL")
+
+
+def percentile(values, p):
+    """Nearest-rank percentile, math.inf when it falls on an undiscovered entry."""
+    if not values:
+        return math.inf
+    ordered = sorted(values)
+    return ordered[max(0, math.ceil(p / 100 * len(ordered)) - 1)]
+
+
+def build(app, build_dir):
+    subprocess.run(["west", "build", "-b", BOARD, "-d", str(build_dir), str(REPO / app)],
+                   check=True)
+
+
+def run(exe, devices, sim_length_s, spread_ms, seed, log_dir):
+    """Runs the phy and one process per device, each device logging to its own file."""
+    bsim_bin = Path(os.environ["BSIM_OUT_PATH"]) / "bin"
+    sim_id = f"blend_{exe.parent.parent.name}_{devices}"
+    rng = random.Random(seed)
+    procs = []
+
+    log_dir.mkdir(parents=True, exist_ok=True)
+    for d in range(devices):
+        # devices power up at random times, so their epochs start out of phase
+        offset_us = rng.randrange(spread_ms * 1000) if spread_ms else 0
+        log = open(log_dir / f"d_{d:02d}.log", "w")
+        procs.append(subprocess.Popen(
+            [str(exe), f"-s={sim_id}", f"-d={d}", f"-rs={seed * 1000 + d}",
+             f"-start_offset={offset_us}"],
+            cwd=bsim_bin, stdout=log, stderr=subprocess.STDOUT))
+    phy = subprocess.run(
+        ["./bs_2G4_phy_v1", f"-s={sim_id}", f"-D={devices}",
+         f"-sim_length={sim_length_s * 1000000}"],
+        cwd=bsim_bin, stdout=subprocess.DEVNULL)
+    for p in procs:
+        p.wait()
+    if phy.returncode:
+        raise RuntimeError(f"bs_2G4_phy_v1 exited with {phy.returncode}")
+
+
+def parse(log_dir):
+    """Returns, per device, its identity, when it was up and its events as (ms, line)."""
+    devices = {}
+
+    for path in sorted(log_dir.glob("d_*.log")):
+        dev = {"identity": None, "ready_ms": None, "events": []}
+        for raw in path.read_text(errors="replace").splitlines():
+            m = LINE_RE.match(raw)
+            if not m:
+                continue
+            h, mi, s, us = (int(x) for x in m.group(2, 3, 4, 5))
+            t_ms = ((h * 60 + mi) * 60 + s) * 1000 + us / 1000
+            text = m.group(6)
+            ident = IDENTITY_RE.search(text)
+            if ident and dev["identity"] is None:
+                dev["identity"] = ident.group(1)
+            elif READY_RE.search(text) and dev["ready_ms"] is None:
+                dev["ready_ms"] = t_ms
+            else:
+                dev["events"].append((t_ms, text))
+        devices[int(path.stem[2:])] = dev
+    return devices
+
+
+def discovery_results(devices):
+    """Pair latencies of demo, from the time both devices were up."""
+    by_addr = {d["identity"]: i for i, d in devices.items() if d["identity"]}
+    first = {}
+
+    for i, dev in devices.items():
+        for t_ms, text in dev["events"]:
+            m = NEIGHBOR_RE.search(text)
+            j = by_addr.get(m.group(1)) if m else None
+            if j is None or j == i:
+                continue
+            pair = (min(i, j), max(i, j))
+            up_ms = max(dev["ready_ms"] or 0, devices[j]["ready_ms"] or 0)
+            latency = max(0.0, t_ms - up_ms)
+            first[pair] = min(first.get(pair, math.inf), latency)
+    ids = sorted(devices)
+    latencies = [first.get((a, b), math.inf) for n, a in enumerate(ids) for b in ids[n + 1:]]
+    found = sum(1 for x in latencies if x != math.inf)
+    return {
+        "pair_p50_ms": percentile(latencies, 50),
+        "pair_p90_ms": percentile(latencies, 90),
+        "pair_p99_ms": percentile(latencies, 99),
+        "pairs_discovered_pct": 100.0 * found / len(latencies) if latencies else 0.0,
+    }
+
+
+def connection_results(devices):
+    """Connection setup times of demo_connect, measured on the centrals."""
+    setups = []
+    connected = 0
+
+    for dev in devices.values():
+        sighted_ms = None
+        was_connected = False
+        for t_ms, text in dev["events"]:
+            if NEIGHBOR_RE.search(text) and sighted_ms is None:
+                # the scan module initiates on the first filter match
+                sighted_ms = t_ms
+            elif CENTRAL_RE.search(text):
+                was_connected = True
+                if sighted_ms is not None:
+                    setups.append(t_ms - sighted_ms)
+                sighted_ms = None
+            elif PERIPHERAL_RE.search(text):
+                was_connected = True
+        connected += was_connected
+    return {
+        "connect_p50_ms": percentile(setups, 50),
+        "connect_max_ms": max(setups, default=math.inf),
+        "connected_pct": 100.0 * connected / len(devices) if devices else 0.0,
+    }
+
+
+RESULTS = {"demo": discovery_results, "demo_connect": connection_results}
+
+
+def git_describe(path):
+    """Version of the git checkout at path, None if there is none."""
+    if not path or not Path(path).is_dir():
+        return None
+    out = subprocess.run(["git", "-C", str(path), "describe", "--tags", "--always", "--dirty"],
+                         capture_output=True, text=True)
+    return out.stdout.strip() or None
+
+
+def provenance():
+    """Versions of the simulator and the SDK a baseline is recorded with."""
+    zephyr = os.environ.get("ZEPHYR_BASE")
+    bsim = os.environ.get("BSIM_COMPONENTS_PATH") or os.environ.get("BSIM_OUT_PATH")
+    ncs_version = Path(zephyr).parent / "nrf" / "VERSION" if zephyr else None
+    return {
+        "bsim": git_describe(bsim),
+        "zephyr": git_describe(zephyr),
+        "ncs": (ncs_version.read_text().strip() if ncs_version and ncs_version.exists()
+                else git_describe(Path(zephyr).parent / "nrf" if zephyr else None)),
+    }
+
+
+def check(results, baseline, tolerance):
+    """Returns the names of the results that regressed from the baseline.
+
+    A latency the baseline run never reached is recorded as null and read as math.inf, which
+    every result meets: not reaching it again passes, reaching it is an improvement.
+    """
+    failed = []
+
+    for name, value in results.items():
+        if name not in baseline or baseline[name] == math.inf:
+            continue
+        if name.endswith("_pct"):
+            bad = value < baseline[name] - SHARE_TOLERANCE_PCT
+        else:
+            bad = value > baseline[name] * (1 + tolerance)
+        if bad:
+            failed.append(name)
+    return failed
+
+
+def show(value):
+    return "-" if value == math.inf else f"{value:.0f}" if value >= 10 else f"{value:.1f}"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("--apps", nargs="+", default=list(RESULTS), choices=list(RESULTS))
+    parser.add_argument("--devices", nargs="+", type=int, default=[2, 8, 32])
+    parser.add_argument("--sim-length", type=int, default=300,
+                        help="simulated time per scenario in seconds")
+    parser.add_argument("--start-spread", type=int, default=10000,
+                        help="devices power up at random within this many milliseconds")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--build", action="store_true", help="build the apps with west first")
+    parser.add_argument("--build-dir", type=Path, default=REPO / "build" / "bsim")
+    parser.add_argument("--logs-only", action="store_true",
+                        help="check the logs of an earlier run instead of running")
+    parser.add_argument("--baseline", type=Path, default=DEFAULT_BASELINE)
+    parser.add_argument("--tolerance", type=float, default=0.1,
+                        help="allowed rise of a latency over its baseline, as a fraction")
+    parser.add_argument("--update-baseline", action="store_true")
+    args = parser.parse_args()
+
+    if not args.logs_only and "BSIM_OUT_PATH" not in os.environ:
+        print("BSIM_OUT_PATH is not set", file=sys.stderr)
+        return 2
+    baseline = json.loads(args.baseline.read_text()) if args.baseline.exists() else {}
+    settings = {"sim_length": args.sim_length, "start_spread": args.start_spread,
+                "seed": args.seed}
+    regressions = 0
+
+    if args.update_baseline:
+        recorded = provenance()
+        if None in recorded.values():
+            print(f"cannot tell the versions to record, {recorded}: set ZEPHYR_BASE and "
+                  "BSIM_COMPONENTS_PATH", file=sys.stderr)
+            return 2
+        baseline["recorded_with"] = recorded
+        baseline["settings"] = settings
+    elif not baseline.get("recorded_with"):
+        print(f"{args.baseline} holds no recorded run, see --update-baseline", file=sys.stderr)
+        return 2
+    elif any(baseline.get("settings", {}).get(k) != settings[k] for k in SETTINGS):
+        print(f"{args.baseline} was recorded with {baseline.get('settings')}, not {settings}",
+              file=sys.stderr)
+        return 2
+    recorded = baseline["recorded_with"]
+    print(f"baseline: BabbleSim {recorded.get('bsim')}, Zephyr {recorded.get('zephyr')}, "
+          f"nRF Connect SDK {recorded.get('ncs')}")
+
+    for app in args.apps:
+        app_dir = args.build_dir / app
+        exe = app_dir / "zephyr" / "zephyr.exe"
+        if args.build and not args.logs_only:
+            build(app, app_dir)
+        for n in args.devices:
+            log_dir = args.build_dir / "logs" / f"{app}_{n}"
+            if not args.logs_only:
+                run(exe, n, args.sim_length, args.start_spread, args.seed, log_dir)
+            devices = parse(log_dir)
+            if not devices:
+                print(f"{app}, {n} devices: no logs in {log_dir}", file=sys.stderr)
+                return 2
+            results = RESULTS[app](devices)
+            expected = baseline.get(app, {}).get(str(n))
+            if expected is None and not args.update_baseline:
+                print(f"{app}, {n} devices: no baseline recorded", file=sys.stderr)
+                return 2
+            expected = {k: math.inf if v is None else v for k, v in (expected or {}).items()}
+            failed = check(results, expected, args.tolerance) if not args.update_baseline else []
+            regressions += len(failed)
+            print(f"{app}, {n} devices, {args.sim_length} s: {'FAIL' if failed else 'pass'}")
+            for name, value in results.items():
+                mark = "  REGRESSED" if name in failed else ""
+                print(f"  {name:22s}{show(value):>10s}  baseline {show(expected.get(name, math.inf))}"
+                      f"{mark}")
+            if args.update_baseline:
+                # JSON has no infinity, so a result never reached is recorded as null
+                baseline.setdefault(app, {})[str(n)] = {
+                    k: None if v == math.inf else round(v, 1) for k, v in results.items()}
+
+    if args.update_baseline:
+        args.baseline.write_text(json.dumps(baseline, indent=2) + "\n")
+        print(f"baseline written to {args.baseline}")
+        return 0
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,78 @@
+/*
+ * blend_opt: host-side BLEnd parameter optimizer
+ *
+ * usage: blend_opt -l <latency ms> -p <probability> -n <neighbors> [-b] [-a <airtime us>] [-c <channels>]
+ * Prints the epoch length and advertising interval to pass to blend_init.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "blend_opt.h"
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s -l <latency ms> -p <probability> -n <neighbors> [-b] [-a <airtime us>] [-c <channels>]\n"
+		"  -l  discovery latency bound in milliseconds\n"
+		"  -p  probability of discovery within the bound, e.g. 0.95\n"
+		"  -n  expected number of nodes in range\n"
+		"  -b  B-BLEnd (bidirectional) layout\n"
+		"  -a  airtime of one advertising event in microseconds, e.g. for the 2M profile\n"
+		"  -c  number of primary advertising channels used, 1 to 3\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct blend_opt_target target = { 0 };
+	struct blend_opt_result result;
+	struct blend_opt_layout layout;
+	int opt, err;
+
+	while ((opt = getopt(argc, argv, "l:p:n:a:c:bh")) != -1) {
+		switch (opt) {
+		case 'l':
+			target.latency_ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			target.probability = strtof(optarg, NULL);
+			break;
+		case 'n':
+			target.neighbors = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			target.bidirectional = true;
+			break;
+		case 'a':
+			target.radio.beacon_us = strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			target.radio.channels = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	err = blend_opt_solve(&target, &result);
+	if (err) {
+		fprintf(stderr, "%s\n", err == -ENOENT ? "no (E, A) pair meets the target" : "invalid target");
+		if (err != -ENOENT) {
+			usage(argv[0]);
+		}
+		return 1;
+	}
+	blend_opt_layout(result.epoch_ms, result.adv_interval, target.bidirectional, &target.radio, &layout);
+
+	printf("EPOCH_DURATION %u\n", result.epoch_ms);
+	printf("ADV_INTERVAL   %u\t// %.3f ms\n", result.adv_interval, result.adv_interval * 0.625);
+	printf("scan %u ms, advertise %u ms, lead %u ms, %u beacons per epoch\n",
+	       layout.scan_ms, layout.adv_ms, layout.lead_ms, layout.beacons);
+	printf("duty cycle %.2f %%, discovery probability %.4f\n",
+	       result.duty_cycle * 100, result.probability);
+	return 0;
+}
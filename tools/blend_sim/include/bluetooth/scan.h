@@ -0,0 +1,71 @@
+#ifndef SIM_BLUETOOTH_SCAN_H
+#define SIM_BLUETOOTH_SCAN_H
+
+/* Scanning module shim of the BLEnd simulator, only the manufacturer data filter */
+
+#include <zephyr/bluetooth/bluetooth.h>
+
+struct bt_le_conn_param;
+
+struct bt_scan_device_info {
+	const struct bt_le_scan_recv_info *recv_info;
+	const struct bt_le_conn_param *conn_param;
+	struct net_buf_simple *adv_data;
+};
+
+struct bt_scan_manufacturer_data {
+	uint8_t *data;
+	uint8_t data_len;
+};
+
+struct bt_scan_filter_match {
+	struct {
+		bool match;
+		const struct bt_scan_manufacturer_data *val;
+	} manufacturer_data;
+	bool all_mask;
+};
+
+struct bt_scan_init_param {
+	const struct bt_le_scan_param *scan_param;
+	bool connect_if_match;
+	const struct bt_le_conn_param *conn_param;
+};
+
+enum bt_scan_type {
+	BT_SCAN_TYPE_SCAN_PASSIVE,
+	BT_SCAN_TYPE_SCAN_ACTIVE,
+};
+
+enum bt_scan_filter_type {
+	BT_SCAN_FILTER_TYPE_NAME,
+	BT_SCAN_FILTER_TYPE_MANUFACTURER_DATA,
+};
+
+#define BT_SCAN_MANUFACTURER_DATA_FILTER BIT(6)
+
+struct bt_scan_cb {
+	struct {
+		void (*filter_match)(struct bt_scan_device_info *device_info,
+				     struct bt_scan_filter_match *filter_match, bool connectable);
+		void (*filter_no_match)(struct bt_scan_device_info *device_info, bool connectable);
+		void (*connecting_error)(struct bt_scan_device_info *device_info);
+		void (*connecting)(struct bt_scan_device_info *device_info, struct bt_conn *conn);
+	} cb_addr;
+};
+
+#define BT_SCAN_CB_INIT(_name, match_fun, no_match_fun, conn_err_fun, connecting_fun)              \
+	static struct bt_scan_cb _name = {                                                         \
+		.cb_addr = { match_fun, no_match_fun, conn_err_fun, connecting_fun },              \
+	}
+
+void bt_scan_init(const struct bt_scan_init_param *init);
+void bt_scan_cb_register(struct bt_scan_cb *cb);
+int bt_scan_params_set(struct bt_le_scan_param *scan_param);
+int bt_scan_start(enum bt_scan_type scan_type);
+int bt_scan_stop(void);
+int bt_scan_filter_add(enum bt_scan_filter_type type, const void *data);
+void bt_scan_filter_remove_all(void);
+int bt_scan_filter_enable(uint8_t mode, bool match_all);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef SIM_DK_BUTTONS_AND_LEDS_H
+#define SIM_DK_BUTTONS_AND_LEDS_H
+
+#include <zephyr/types.h>
+
+/* the simulated nodes have no LEDs */
+
+#define DK_LED1 0
+#define DK_LED2 1
+#define DK_LED3 2
+#define DK_LED4 3
+
+static inline int dk_set_led(uint8_t led_idx, uint32_t val)
+{
+	(void)led_idx;
+	(void)val;
+	return 0;
+}
+
+#endif
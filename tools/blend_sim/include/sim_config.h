@@ -0,0 +1,25 @@
+/* Kconfig values of the simulated firmware
+ *
+ * Forced into every node source with -include, in place of Zephyr's autoconf.h. Values a
+ * simulation run may want to change can be set from CMake, see CMakeLists.txt.
+ */
+#ifndef SIM_CONFIG_H
+#define SIM_CONFIG_H
+
+#define CONFIG_BT_DEVICE_NAME "BLEndSim"
+#define CONFIG_SYS_CLOCK_TICKS_PER_SEC 32768
+#define CONFIG_BLEND_WORKQ_STACK_SIZE 1
+#define CONFIG_BLEND_WORKQ_PRIORITY 2
+#ifndef CONFIG_BLEND_NEIGHBOR_MAX
+#define CONFIG_BLEND_NEIGHBOR_MAX 64
+#endif
+#define CONFIG_BLEND_NEIGHBOR_MAX_AGE_MS 60000
+/* nothing drains the ring in the simulator, keep its copy in the node image small */
+#define CONFIG_BLEND_DISCOVERY_RING_SIZE 2
+#define CONFIG_BLEND_SYNC_FULL_SCAN_PERIOD 8
+#define CONFIG_BLEND_SYNC_GUARD_MS 15
+#define CONFIG_BLEND_ADV_CHANNEL_GAP_US 400
+#define CONFIG_BLEND_ADV_AUX_GAP_US 300
+#define CONFIG_BLEND_BEACON_DATA_MAX 0
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef SIM_ZEPHYR_BLUETOOTH_ADDR_H
+#define SIM_ZEPHYR_BLUETOOTH_ADDR_H
+
+#include <zephyr/types.h>
+#include <string.h>
+
+#define BT_ADDR_LE_PUBLIC 0x00
+#define BT_ADDR_LE_RANDOM 0x01
+#define BT_ADDR_LE_STR_LEN 30
+
+typedef struct {
+	uint8_t val[6];
+} bt_addr_t;
+
+typedef struct {
+	uint8_t type;
+	bt_addr_t a;
+} bt_addr_le_t;
+
+static inline int bt_addr_le_cmp(const bt_addr_le_t *a, const bt_addr_le_t *b)
+{
+	return memcmp(a, b, sizeof(*a));
+}
+
+static inline bool bt_addr_le_eq(const bt_addr_le_t *a, const bt_addr_le_t *b)
+{
+	return bt_addr_le_cmp(a, b) == 0;
+}
+
+static inline void bt_addr_le_copy(bt_addr_le_t *dst, const bt_addr_le_t *src)
+{
+	memcpy(dst, src, sizeof(*dst));
+}
+
+int bt_addr_le_to_str(const bt_addr_le_t *addr, char *str, size_t len);
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef SIM_ZEPHYR_BLUETOOTH_BLUETOOTH_H
+#define SIM_ZEPHYR_BLUETOOTH_BLUETOOTH_H
+
+/* Bluetooth host shim of the BLEnd simulator
+ *
+ * The advertising and scanning calls of the BLEnd sources, served by the radio model in radio.c.
+ * Everything the calls point to is copied, since the node images are swapped between calls.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/addr.h>
+#include <zephyr/bluetooth/gap.h>
+
+struct net_buf_simple {
+	uint8_t *data;
+	uint16_t len;
+	uint16_t size;
+};
+
+void net_buf_simple_init_with_data(struct net_buf_simple *buf, void *data, size_t size);
+
+struct bt_data {
+	uint8_t type;
+	uint8_t data_len;
+	const uint8_t *data;
+};
+
+#define BT_DATA(_type, _data, _data_len)                                                           \
+	{ .type = (_type), .data_len = (_data_len), .data = (const uint8_t *)(_data) }
+
+#define BT_DATA_FLAGS 0x01
+#define BT_DATA_NAME_SHORTENED 0x08
+#define BT_DATA_NAME_COMPLETE 0x09
+#define BT_DATA_MANUFACTURER_DATA 0xff
+#define BT_LE_AD_NO_BREDR 0x04
+
+void bt_data_parse(struct net_buf_simple *ad, bool (*func)(struct bt_data *data, void *user_data),
+		   void *user_data);
+
+void bt_id_get(bt_addr_le_t *addrs, size_t *count);
+
+/* extended advertising */
+enum {
+	BT_LE_ADV_OPT_NONE = 0,
+	BT_LE_ADV_OPT_CONNECTABLE = BIT(0),
+	BT_LE_ADV_OPT_USE_IDENTITY = BIT(2),
+	BT_LE_ADV_OPT_EXT_ADV = BIT(10),
+	BT_LE_ADV_OPT_NO_2M = BIT(11),
+	BT_LE_ADV_OPT_CODED = BIT(12),
+	BT_LE_ADV_OPT_DISABLE_CHAN_37 = BIT(15),
+	BT_LE_ADV_OPT_DISABLE_CHAN_38 = BIT(16),
+	BT_LE_ADV_OPT_DISABLE_CHAN_39 = BIT(17),
+};
+
+struct bt_le_adv_param {
+	uint8_t id;
+	uint8_t sid;
+	uint8_t secondary_max_skip;
+	uint32_t options;
+	uint32_t interval_min;
+	uint32_t interval_max;
+	const bt_addr_le_t *peer;
+};
+
+#define BT_LE_ADV_PARAM_INIT(_options, _int_min, _int_max, _peer)                                  \
+	{ .options = (_options), .interval_min = (_int_min), .interval_max = (_int_max),           \
+	  .peer = (_peer) }
+#define BT_LE_ADV_PARAM(_options, _int_min, _int_max, _peer)                                       \
+	((struct bt_le_adv_param[]){ BT_LE_ADV_PARAM_INIT(_options, _int_min, _int_max, _peer) })
+
+struct bt_le_ext_adv;
+struct bt_conn;
+
+struct bt_le_ext_adv_sent_info {
+	uint8_t num_sent;
+};
+
+struct bt_le_ext_adv_connected_info {
+	struct bt_conn *conn;
+};
+
+struct bt_le_ext_adv_cb {
+	void (*sent)(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_sent_info *info);
+	void (*connected)(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_connected_info *info);
+};
+
+struct bt_le_ext_adv_start_param {
+	uint16_t timeout;
+	uint8_t num_events;
+};
+
+int bt_le_ext_adv_create(const struct bt_le_adv_param *param, const struct bt_le_ext_adv_cb *cb,
+			 struct bt_le_ext_adv **adv);
+int bt_le_ext_adv_start(struct bt_le_ext_adv *adv, const struct bt_le_ext_adv_start_param *param);
+int bt_le_ext_adv_stop(struct bt_le_ext_adv *adv);
+int bt_le_ext_adv_set_data(struct bt_le_ext_adv *adv, const struct bt_data *ad, size_t ad_len,
+			   const struct bt_data *sd, size_t sd_len);
+int bt_le_ext_adv_update_param(struct bt_le_ext_adv *adv, const struct bt_le_adv_param *param);
+
+/* periodic advertising, not modelled: the simulated nodes run without CONFIG_BLEND_GROUP */
+struct bt_le_per_adv_param {
+	uint16_t interval_min;
+	uint16_t interval_max;
+	uint32_t options;
+};
+
+#define BT_LE_PER_ADV_OPT_NONE 0
+#define BT_LE_PER_ADV_PARAM(_int_min, _int_max, _options)                                          \
+	((struct bt_le_per_adv_param[]){                                                           \
+		{ .interval_min = (_int_min), .interval_max = (_int_max), .options = (_options) } })
+
+int bt_le_per_adv_set_param(struct bt_le_ext_adv *adv, const struct bt_le_per_adv_param *param);
+int bt_le_per_adv_set_data(const struct bt_le_ext_adv *adv, const struct bt_data *ad,
+			   size_t ad_len);
+int bt_le_per_adv_start(struct bt_le_ext_adv *adv);
+int bt_le_per_adv_stop(struct bt_le_ext_adv *adv);
+
+/* scanning */
+enum {
+	BT_LE_SCAN_TYPE_PASSIVE = 0,
+	BT_LE_SCAN_TYPE_ACTIVE = 1,
+};
+
+enum {
+	BT_LE_SCAN_OPT_NONE = 0,
+	BT_LE_SCAN_OPT_FILTER_DUPLICATE = BIT(0),
+	BT_LE_SCAN_OPT_CODED = BIT(2),
+	BT_LE_SCAN_OPT_NO_1M = BIT(3),
+};
+
+struct bt_le_scan_param {
+	uint8_t type;
+	uint32_t options;
+	uint16_t interval;
+	uint16_t window;
+	uint16_t timeout;
+	uint16_t interval_coded;
+	uint16_t window_coded;
+};
+
+struct bt_le_scan_recv_info {
+	const bt_addr_le_t *addr;
+	uint8_t sid;
+	int8_t rssi;
+	int8_t tx_power;
+	uint8_t adv_type;
+	uint16_t adv_props;
+	uint16_t interval;
+	uint8_t primary_phy;
+	uint8_t secondary_phy;
+};
+
+struct bt_le_scan_cb {
+	void (*recv)(const struct bt_le_scan_recv_info *info, struct net_buf_simple *buf);
+	void (*timeout)(void);
+};
+
+int bt_le_scan_cb_register(struct bt_le_scan_cb *cb);
+
+#endif
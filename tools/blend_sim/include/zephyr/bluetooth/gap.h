@@ -0,0 +1,16 @@
+#ifndef SIM_ZEPHYR_BLUETOOTH_GAP_H
+#define SIM_ZEPHYR_BLUETOOTH_GAP_H
+
+#define BT_GAP_SCAN_SLOW_INTERVAL_1 0x0800
+#define BT_GAP_ADV_MAX_ADV_DATA_LEN 31
+#define BT_GAP_ADV_MAX_EXT_ADV_DATA_LEN 251
+#define BT_GAP_LE_PHY_NONE 0
+#define BT_GAP_LE_PHY_1M 1
+#define BT_GAP_LE_PHY_2M 2
+#define BT_GAP_LE_PHY_CODED 3
+#define BT_GAP_SID_INVALID 0xff
+#define BT_GAP_ADV_PROP_EXT_ADV 0x10
+#define BT_GAP_ADV_TYPE_ADV_NONCONN_IND 0x03
+#define BT_GAP_ADV_TYPE_EXT_ADV 0x05
+
+#endif
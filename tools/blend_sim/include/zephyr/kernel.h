@@ -0,0 +1,215 @@
+#ifndef SIM_ZEPHYR_KERNEL_H
+#define SIM_ZEPHYR_KERNEL_H
+
+/* Kernel shim of the BLEnd simulator
+ *
+ * Just enough of the Zephyr kernel API for the BLEnd sources, on simulated time. Every node runs
+ * on the same host thread, one event at a time: timers and work items become events of the
+ * simulator, locks are no-ops and a handler runs to completion before the next event.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/atomic.h>
+#include <string.h>
+#include <errno.h>
+
+#define USEC_PER_MSEC 1000U
+#define MSEC_PER_SEC 1000U
+#define USEC_PER_SEC 1000000U
+
+typedef int64_t k_ticks_t;
+
+typedef struct {
+	k_ticks_t ticks; /* K_TICKS_FOREVER for no timeout */
+	bool abs;        /* ticks is an uptime, not a delay */
+} k_timeout_t;
+
+#define K_TICKS_FOREVER ((k_ticks_t)-1)
+#define K_NO_WAIT ((k_timeout_t){ .ticks = 0 })
+#define K_FOREVER ((k_timeout_t){ .ticks = K_TICKS_FOREVER })
+#define K_TICKS(t) ((k_timeout_t){ .ticks = (t) })
+#define K_MSEC(ms) ((k_timeout_t){ .ticks = (k_ticks_t)k_ms_to_ticks_ceil64(ms) })
+#define K_USEC(us) ((k_timeout_t){ .ticks = (k_ticks_t)k_us_to_ticks_ceil64(us) })
+#define K_TIMEOUT_ABS_TICKS(t) ((k_timeout_t){ .ticks = (t), .abs = true })
+#define K_TIMEOUT_ABS_MS(t) K_TIMEOUT_ABS_TICKS((k_ticks_t)k_ms_to_ticks_ceil64(t))
+
+#define K_PRIO_COOP(x) (-((x) + 1))
+#define K_PRIO_PREEMPT(x) (x)
+
+/* time conversions, for CONFIG_SYS_CLOCK_TICKS_PER_SEC ticks and a 1 MHz cycle counter */
+static inline uint64_t k_ms_to_ticks_ceil64(uint64_t ms)
+{
+	return DIV_ROUND_UP(ms * CONFIG_SYS_CLOCK_TICKS_PER_SEC, MSEC_PER_SEC);
+}
+
+static inline uint64_t k_ms_to_ticks_floor64(uint64_t ms)
+{
+	return ms * CONFIG_SYS_CLOCK_TICKS_PER_SEC / MSEC_PER_SEC;
+}
+
+static inline uint64_t k_us_to_ticks_ceil64(uint64_t us)
+{
+	return DIV_ROUND_UP(us * CONFIG_SYS_CLOCK_TICKS_PER_SEC, USEC_PER_SEC);
+}
+
+static inline uint64_t k_ticks_to_ms_floor64(uint64_t t)
+{
+	return t * MSEC_PER_SEC / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+}
+
+static inline uint64_t k_ticks_to_us_floor64(uint64_t t)
+{
+	return t * USEC_PER_SEC / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+}
+
+static inline uint32_t k_cyc_to_us_floor32(uint32_t cyc)
+{
+	return cyc;
+}
+
+static inline uint32_t sys_clock_hw_cycles_per_sec(void)
+{
+	return USEC_PER_SEC;
+}
+
+/* clocks of the node that is running, see sim.c */
+k_ticks_t k_uptime_ticks(void);
+uint32_t k_cycle_get_32(void);
+
+static inline int64_t k_uptime_get(void)
+{
+	return k_ticks_to_ms_floor64(k_uptime_ticks());
+}
+
+static inline uint32_t k_uptime_get_32(void)
+{
+	return (uint32_t)k_uptime_get();
+}
+
+/* locks: a handler is never preempted */
+struct k_spinlock {
+	char unused;
+};
+
+typedef int k_spinlock_key_t;
+
+static inline k_spinlock_key_t k_spin_lock(struct k_spinlock *l)
+{
+	ARG_UNUSED(l);
+	return 0;
+}
+
+static inline void k_spin_unlock(struct k_spinlock *l, k_spinlock_key_t key)
+{
+	ARG_UNUSED(l);
+	ARG_UNUSED(key);
+}
+
+static inline unsigned int irq_lock(void)
+{
+	return 0;
+}
+
+static inline void irq_unlock(unsigned int key)
+{
+	ARG_UNUSED(key);
+}
+
+struct k_mutex {
+	char unused;
+};
+
+#define K_MUTEX_DEFINE(name) struct k_mutex name
+
+static inline int k_mutex_lock(struct k_mutex *m, k_timeout_t timeout)
+{
+	ARG_UNUSED(m);
+	ARG_UNUSED(timeout);
+	return 0;
+}
+
+static inline int k_mutex_unlock(struct k_mutex *m)
+{
+	ARG_UNUSED(m);
+	return 0;
+}
+
+/* semaphores never block: nothing else could run while a node waits */
+struct k_sem {
+	unsigned int count;
+	unsigned int limit;
+};
+
+#define K_SEM_DEFINE(name, initial, max) struct k_sem name = { (initial), (max) }
+
+static inline void k_sem_give(struct k_sem *sem)
+{
+	if (sem->count < sem->limit) {
+		sem->count++;
+	}
+}
+
+static inline int k_sem_take(struct k_sem *sem, k_timeout_t timeout)
+{
+	ARG_UNUSED(timeout);
+	if (sem->count == 0) {
+		return -EAGAIN;
+	}
+	sem->count--;
+	return 0;
+}
+
+/* timers: an expiry is an event of the node that started the timer */
+struct k_timer;
+typedef void (*k_timer_expiry_t)(struct k_timer *timer);
+
+struct k_timer {
+	k_timer_expiry_t expiry_fn;
+	k_timer_expiry_t stop_fn;
+	k_ticks_t period;
+	uint32_t gen; /* bumped by every start and stop, so stale expiries are dropped */
+	bool running;
+};
+
+#define K_TIMER_DEFINE(name, expiry, stop) struct k_timer name = { (expiry), (stop), 0, 0, false }
+
+void k_timer_init(struct k_timer *timer, k_timer_expiry_t expiry_fn, k_timer_expiry_t stop_fn);
+void k_timer_start(struct k_timer *timer, k_timeout_t duration, k_timeout_t period);
+void k_timer_stop(struct k_timer *timer);
+
+/* work queues: a submitted item runs after a fixed latency, in submission order */
+struct k_work;
+typedef void (*k_work_handler_t)(struct k_work *work);
+
+struct k_work {
+	k_work_handler_t handler;
+	uint32_t gen;
+	bool pending;
+};
+
+#define K_WORK_DEFINE(name, work_handler) struct k_work name = { (work_handler), 0, false }
+
+struct k_work_q {
+	bool started;
+};
+
+struct k_work_queue_config {
+	const char *name;
+	bool no_yield;
+};
+
+typedef char k_thread_stack_t;
+
+/* the queues run on the simulator thread and need no stack */
+#define K_THREAD_STACK_DEFINE(name, size) k_thread_stack_t name[1]
+#define K_THREAD_STACK_SIZEOF(sym) sizeof(sym)
+
+void k_work_init(struct k_work *work, k_work_handler_t handler);
+int k_work_submit(struct k_work *work);
+int k_work_submit_to_queue(struct k_work_q *queue, struct k_work *work);
+bool k_work_cancel(struct k_work *work);
+void k_work_queue_start(struct k_work_q *queue, k_thread_stack_t *stack, size_t stack_size, int prio,
+			const struct k_work_queue_config *cfg);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SIM_ZEPHYR_LOGGING_LOG_H
+#define SIM_ZEPHYR_LOGGING_LOG_H
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERR 1
+#define LOG_LEVEL_WRN 2
+#define LOG_LEVEL_INF 3
+#define LOG_LEVEL_DBG 4
+
+/* Printed with the node and the simulated time when the level is within the module's level and
+ * the verbosity of the run, see sim_log(). */
+void sim_log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define LOG_MODULE_REGISTER(name, level) static const int sim_log_module_level = (level)
+#define LOG_MODULE_DECLARE(name, ...)
+
+#define SIM_LOG(level, ...)                                                                        \
+	do {                                                                                       \
+		if ((level) <= sim_log_module_level) {                                             \
+			sim_log(level, __VA_ARGS__);                                               \
+		}                                                                                  \
+	} while (0)
+
+#define LOG_ERR(...) SIM_LOG(LOG_LEVEL_ERR, __VA_ARGS__)
+#define LOG_WRN(...) SIM_LOG(LOG_LEVEL_WRN, __VA_ARGS__)
+#define LOG_INF(...) SIM_LOG(LOG_LEVEL_INF, __VA_ARGS__)
+#define LOG_DBG(...) SIM_LOG(LOG_LEVEL_DBG, __VA_ARGS__)
+#define LOG_HEXDUMP_INF(data, len, str) ((void)(data), (void)(len), (void)(str))
+#define LOG_HEXDUMP_DBG(data, len, str) ((void)(data), (void)(len), (void)(str))
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SIM_ZEPHYR_SYS_ATOMIC_H
+#define SIM_ZEPHYR_SYS_ATOMIC_H
+
+#include <zephyr/types.h>
+
+/* The simulator runs one node at a time on one thread, so plain accesses are atomic. */
+typedef long atomic_t;
+typedef long atomic_val_t;
+
+#define ATOMIC_INIT(i) (i)
+
+static inline atomic_val_t atomic_get(const atomic_t *target)
+{
+	return *target;
+}
+
+static inline atomic_val_t atomic_set(atomic_t *target, atomic_val_t value)
+{
+	atomic_val_t old = *target;
+
+	*target = value;
+	return old;
+}
+
+static inline atomic_val_t atomic_inc(atomic_t *target)
+{
+	return (*target)++;
+}
+
+static inline atomic_val_t atomic_dec(atomic_t *target)
+{
+	return (*target)--;
+}
+
+static inline bool atomic_cas(atomic_t *target, atomic_val_t old_value, atomic_val_t new_value)
+{
+	if (*target != old_value) {
+		return false;
+	}
+	*target = new_value;
+	return true;
+}
+
+#endif
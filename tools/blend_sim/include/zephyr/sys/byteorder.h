@@ -0,0 +1,33 @@
+#ifndef SIM_ZEPHYR_SYS_BYTEORDER_H
+#define SIM_ZEPHYR_SYS_BYTEORDER_H
+
+#include <zephyr/types.h>
+
+/* little-endian hosts only, like the nRF52 */
+#define sys_cpu_to_le16(x) ((uint16_t)(x))
+#define sys_le16_to_cpu(x) ((uint16_t)(x))
+
+static inline uint16_t sys_get_le16(const uint8_t *src)
+{
+	return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+static inline uint32_t sys_get_le32(const uint8_t *src)
+{
+	return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) |
+	       ((uint32_t)src[3] << 24);
+}
+
+static inline void sys_put_le16(uint16_t val, uint8_t *dst)
+{
+	dst[0] = val;
+	dst[1] = val >> 8;
+}
+
+static inline void sys_put_le32(uint32_t val, uint8_t *dst)
+{
+	sys_put_le16(val, dst);
+	sys_put_le16(val >> 16, dst + 2);
+}
+
+#endif
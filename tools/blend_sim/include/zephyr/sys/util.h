@@ -0,0 +1,27 @@
+#ifndef SIM_ZEPHYR_SYS_UTIL_H
+#define SIM_ZEPHYR_SYS_UTIL_H
+
+#include <zephyr/types.h>
+
+#define BIT(n) (1UL << (n))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define ARG_UNUSED(x) (void)(x)
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define CLAMP(v, lo, hi) MIN(MAX(v, lo), hi)
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define ROUND_UP(x, align) (DIV_ROUND_UP(x, align) * (align))
+#define IS_POWER_OF_TWO(x) (((x) != 0U) && (((x) & ((x) - 1U)) == 0U))
+#define POPCOUNT(x) __builtin_popcount(x)
+#define CONTAINER_OF(ptr, type, field) ((type *)(((char *)(ptr)) - offsetof(type, field)))
+#define BUILD_ASSERT(cond, ...) _Static_assert(cond, "" __VA_ARGS__)
+#define __packed __attribute__((__packed__))
+
+/* IS_ENABLED(CONFIG_X) is 1 when CONFIG_X is defined to 1, as in Zephyr */
+#define _XXXX1 _YYYY,
+#define IS_ENABLED(config_macro) _IS_ENABLED1(config_macro)
+#define _IS_ENABLED1(config_macro) _IS_ENABLED2(_XXXX##config_macro)
+#define _IS_ENABLED2(one_or_two_args) _IS_ENABLED3(one_or_two_args 1, 0)
+#define _IS_ENABLED3(ignore_this, val, ...) val
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef SIM_ZEPHYR_TYPES_H
+#define SIM_ZEPHYR_TYPES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#endif
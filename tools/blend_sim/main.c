@@ -0,0 +1,495 @@
+/*
+ * blend_sim: discrete-event simulator of BLEnd discovery
+ *
+ * usage: blend_sim [-n <nodes>] [-p <E>:<A>]... [-l <latency ms> -P <probability> -N <neighbors>]
+ *                  [-b] [-y 1m|2m|coded] [-C <channel mask>] [-t <seconds>] [-s <seed>]
+ *                  [-x <loss>] [-d <ppm>] [-o <step ms>] [-c] [-v]...
+ * Runs the BLEnd firmware on every node for each parameter set and prints the discovery latency
+ * distribution and the radio duty cycle. With -o, checks B-BLEnd's same-epoch two-way discovery
+ * at every offset of two nodes instead, and exits with status 1 if it fails anywhere.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "blend.h"
+#include "advertiser_scanner.h"
+#include "blend_opt.h"
+
+#define SETS_MAX 16
+#define NOT_HEARD UINT32_MAX
+
+/** @brief One parameter set to simulate. */
+struct sim_set {
+	uint32_t epoch_ms;
+	uint16_t adv_interval;
+};
+
+/** @brief Settings shared by all parameter sets. */
+struct sim_options {
+	int nodes;
+	enum blend_mode mode;
+	enum blend_phy phy;
+	uint8_t channels;
+	double seconds;
+	uint64_t seed;
+	double drift_ppm;
+	uint32_t latency_ms; /* target of the optimizer and of the model probability, 0 for none */
+	float probability;
+	uint16_t neighbors;
+	uint32_t sweep_ms;   /* offset step of the two-node check, 0 for an ordinary run */
+	bool cdf;
+};
+
+static struct sim_options opts = {
+	.nodes = 10,
+	.mode = BLEND_MODE_UNIDIRECTIONAL,
+	.phy = BLEND_PHY_1M,
+	.channels = BLEND_CHAN_ALL,
+	.seconds = 60,
+	.seed = 1,
+	.probability = 0.95f,
+};
+
+static const struct sim_set *run_set;
+/* uptime in milliseconds at which each node first heard each other node, by listener */
+static uint32_t *heard;
+
+void sim_node_boot(struct sim_node *node)
+{
+	int err;
+
+	// the boot sequence of demo/src/main.c with the parameters of the run
+	scan_init();
+	adv_init(run_set->adv_interval);
+	err = blend_phy_set(opts.phy);
+	if (!err) {
+		err = blend_channels_set(opts.channels);
+	}
+	if (!err) {
+		err = blend_init(run_set->epoch_ms, run_set->adv_interval, opts.mode);
+	}
+	if (err) {
+		fprintf(stderr, "node %d: BLEnd init failed (err %d)\n", node->id, err);
+		return;
+	}
+	blend_start();
+}
+
+void sim_heard(const struct sim_node *listener, const struct sim_node *sender)
+{
+	uint32_t *t = &heard[(size_t)listener->id * sim_node_count + sender->id];
+
+	if (*t == NOT_HEARD) {
+		*t = DIV_ROUND_UP(sim_now_us(), USEC_PER_MSEC);
+	}
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief Latency of a pair from the time the later of the two nodes booted, INFINITY if never
+ */
+static double pair_latency(int listener, int sender)
+{
+	uint32_t t = heard[(size_t)listener * sim_node_count + sender];
+	int64_t since_us = MAX(sim_nodes[listener].boot_us, sim_nodes[sender].boot_us);
+
+	return t == NOT_HEARD ? INFINITY : t - since_us / 1000.0;
+}
+
+/**
+ * @brief Returns a percentile of sorted latencies, INFINITY if too few pairs discovered
+ */
+static double percentile(const double *v, size_t n, double p)
+{
+	size_t i = (size_t)ceil(p / 100 * n);
+
+	return v[i > 0 ? i - 1 : 0];
+}
+
+static void print_latency(const char *name, const double *v, size_t n)
+{
+	static const double points[] = { 50, 90, 95, 99, 100 };
+	size_t found = 0;
+
+	while (found < n && isfinite(v[found])) {
+		found++;
+	}
+	printf("  %-9s", name);
+	for (size_t i = 0; i < ARRAY_SIZE(points); i++) {
+		double l = percentile(v, n, points[i]);
+
+		if (isfinite(l)) {
+			printf(" %9.0f", l);
+		} else {
+			printf(" %9s", "-");
+		}
+	}
+	printf(" %9.2f %%\n", 100.0 * found / n);
+}
+
+/**
+ * @brief Fraction of latencies within a bound
+ */
+static double within(const double *v, size_t n, double bound)
+{
+	size_t i = 0;
+
+	while (i < n && v[i] <= bound) {
+		i++;
+	}
+	return (double)i / n;
+}
+
+static void report(const struct sim_set *set, double wall_s)
+{
+	size_t n = sim_node_count, pairs = n * (n - 1) / 2;
+	double *one_way = malloc(n * (n - 1) * sizeof(double));
+	double *either = malloc(pairs * sizeof(double));
+	double *mutual = malloc(pairs * sizeof(double));
+	int64_t end_us = (int64_t)(opts.seconds * USEC_PER_SEC);
+	struct blend_opt_radio radio = {
+		.slack_us = BLEND_ADV_DELAY_MAX_US,
+		.channels = POPCOUNT(opts.channels),
+	};
+	struct sim_radio_stats stats;
+	struct blend_margins margins;
+	uint64_t scan_us = 0, tx_us = 0, on_us = 0;
+	size_t k = 0, m = 0;
+
+	if (!one_way || !either || !mutual) {
+		fprintf(stderr, "out of memory for %zu pairs\n", pairs);
+		exit(1);
+	}
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < n; j++) {
+			double a, b;
+
+			if (i == j) {
+				continue;
+			}
+			a = pair_latency(i, j);
+			one_way[k++] = a;
+			if (j < i) {
+				continue;
+			}
+			b = pair_latency(j, i);
+			either[m] = MIN(a, b);
+			mutual[m++] = MAX(a, b);
+		}
+		scan_us += sim_nodes[i].scan_us;
+		tx_us += sim_nodes[i].tx_us;
+		on_us += end_us - sim_nodes[i].boot_us;
+	}
+	qsort(one_way, k, sizeof(double), cmp_double);
+	qsort(either, m, sizeof(double), cmp_double);
+	qsort(mutual, m, sizeof(double), cmp_double);
+
+	sim_node_enter(&sim_nodes[0]);
+	blend_margins_get(&margins);
+	radio.beacon_us = margins.airtime_us;
+	sim_radio_stats_get(&stats);
+
+	printf("E %u ms, A %u (%.3f ms), %s, %u us per beacon: %d nodes for %.1f s\n", set->epoch_ms,
+	       set->adv_interval, set->adv_interval * 0.625,
+	       opts.mode == BLEND_MODE_BIDIRECTIONAL ? "B-BLEnd" : "U-BLEnd", margins.airtime_us,
+	       sim_node_count, opts.seconds);
+	printf("  duty cycle %.2f %% (scan %.2f %%, advertise %.2f %%), model %.2f %%\n",
+	       100.0 * (scan_us + tx_us) / on_us, 100.0 * scan_us / on_us, 100.0 * tx_us / on_us,
+	       100.0 * blend_opt_duty_cycle(set->epoch_ms, set->adv_interval,
+					    opts.mode == BLEND_MODE_BIDIRECTIONAL, &radio));
+	printf("  %llu PDUs, %.2f %% collided, %llu beacons received\n",
+	       (unsigned long long)stats.pdus, stats.pdus ? 100.0 * stats.collided / stats.pdus : 0.0,
+	       (unsigned long long)stats.received);
+	printf("  %-9s %9s %9s %9s %9s %9s %11s\n", "latency", "p50 ms", "p90 ms", "p95 ms", "p99 ms",
+	       "max ms", "discovered");
+	print_latency("one-way", one_way, k);
+	print_latency("pair", either, m);
+	print_latency("mutual", mutual, m);
+	if (opts.latency_ms) {
+		printf("  within %u ms: one-way %.2f %%, model %.2f %%\n", opts.latency_ms,
+		       100.0 * within(one_way, k, opts.latency_ms),
+		       100.0 * blend_opt_probability(set->epoch_ms, set->adv_interval,
+						     opts.mode == BLEND_MODE_BIDIRECTIONAL, sim_node_count,
+						     opts.latency_ms, &radio));
+	}
+	if (opts.cdf) {
+		printf("  %-9s %9s %9s %9s\n", "cdf", "one-way", "pair", "mutual");
+		for (int p = 5; p <= 100; p += 5) {
+			printf("  %8d%% %9.0f %9.0f %9.0f\n", p, percentile(one_way, k, p),
+			       percentile(either, m, p), percentile(mutual, m, p));
+		}
+	}
+	printf("  simulated %.1f s in %.2f s (%.1fx real time)\n\n", opts.seconds, wall_s,
+	       opts.seconds / wall_s);
+	free(one_way);
+	free(either);
+	free(mutual);
+}
+
+static double wall_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Simulates one parameter set from power-up
+ *
+ * Every set starts from the same seed. The nodes boot at random times within the first epoch,
+ * each with a random clock drift within the configured bound.
+ */
+static void run(const struct sim_set *set)
+{
+	int64_t end_us = (int64_t)(opts.seconds * USEC_PER_SEC);
+	double start = wall_seconds();
+
+	run_set = set;
+	sim_reset(opts.seed);
+	memset(heard, 0xff, (size_t)sim_node_count * sim_node_count * sizeof(*heard));
+	for (int i = 0; i < sim_node_count; i++) {
+		struct sim_node *node = &sim_nodes[i];
+
+		node->boot_us = sim_random() % ((uint64_t)set->epoch_ms * USEC_PER_MSEC);
+		node->drift = (2 * sim_random_unit() - 1) * opts.drift_ppm * 1e-6;
+		sim_schedule(node->boot_us, SIM_EV_BOOT, i, NULL, 0);
+	}
+	sim_run(end_us);
+	sim_radio_finish(end_us);
+	report(set, wall_seconds() - start);
+}
+
+/**
+ * @brief Checks that two B-BLEnd nodes hear each other within one epoch at every offset
+ *
+ * The second node boots sweep_ms further into the epoch of the first on every run. Both must
+ * hear each other within one epoch and one scan of the later boot, unless their advertising
+ * events overlapped in time, which is a collision in BLEnd's model. There is no clock drift.
+ *
+ * @return Number of offsets at which the check failed
+ */
+static int sweep(const struct sim_set *set)
+{
+	struct blend_opt_radio radio = {
+		.slack_us = BLEND_ADV_DELAY_MAX_US,
+		.channels = POPCOUNT(opts.channels),
+	};
+	struct blend_opt_layout layout;
+	struct blend_margins margins;
+	struct sim_radio_stats stats;
+	int64_t epoch_us = (int64_t)set->epoch_ms * USEC_PER_MSEC;
+	int offsets = 0, collided = 0, failed = 0;
+	double bound_ms = 0;
+
+	run_set = set;
+	sim_radio.overlap = true;
+	for (int64_t offset_us = 0; offset_us < epoch_us; offset_us += opts.sweep_ms * USEC_PER_MSEC) {
+		double a, b;
+
+		sim_reset(opts.seed);
+		memset(heard, 0xff, 4 * sizeof(*heard));
+		sim_nodes[1].boot_us = offset_us;
+		sim_schedule(0, SIM_EV_BOOT, 0, NULL, 0);
+		sim_schedule(offset_us, SIM_EV_BOOT, 1, NULL, 0);
+		sim_run(offset_us + 2 * epoch_us);
+		sim_radio_stats_get(&stats);
+		if (bound_ms == 0) {
+			sim_node_enter(&sim_nodes[0]);
+			blend_margins_get(&margins);
+			radio.beacon_us = margins.airtime_us;
+			if (blend_opt_layout(set->epoch_ms, set->adv_interval, true, &radio, &layout)) {
+				fprintf(stderr, "E %u ms, A %u: not a B-BLEnd layout\n", set->epoch_ms,
+					set->adv_interval);
+				return 1;
+			}
+			bound_ms = set->epoch_ms + layout.scan_ms;
+		}
+		offsets++;
+		a = pair_latency(0, 1);
+		b = pair_latency(1, 0);
+		if (a <= bound_ms && b <= bound_ms) {
+			continue;
+		}
+		if (stats.overlapped > 0) {
+			collided++;
+			continue;
+		}
+		failed++;
+		printf("  offset %8.3f ms: heard after %.0f ms and %.0f ms\n", offset_us / 1000.0, a, b);
+	}
+	sim_radio.overlap = false;
+	printf("E %u ms, A %u, B-BLEnd: %d offsets %u ms apart, %d missed with overlapping beacons, "
+	       "%d missed otherwise (bound %.0f ms)\n", set->epoch_ms, set->adv_interval, offsets,
+	       opts.sweep_ms, collided, failed, bound_ms);
+	return failed;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n <nodes>] [-p <E>:<A>]... [-l <latency ms>] [-P <probability>] [-N <neighbors>]\n"
+		"          [-b] [-y 1m|2m|coded] [-C <channel mask>] [-t <seconds>] [-s <seed>] [-x <loss>]\n"
+		"          [-d <ppm>] [-o <step ms>] [-c] [-v]...\n"
+		"  -n  number of nodes, all in range of each other\n"
+		"  -p  parameter set: epoch length in ms and advertising interval in 0.625 ms units,\n"
+		"      repeatable; without one, the set blend_opt picks for -l, -P and -N\n"
+		"  -l  latency target in milliseconds, also reported against the model\n"
+		"  -P  probability of discovery within the latency target, for blend_opt\n"
+		"  -N  expected neighbors for blend_opt, the number of nodes by default\n"
+		"  -b  B-BLEnd (bidirectional) layout\n"
+		"  -y  radio profile of the beacons\n"
+		"  -C  primary advertising channels, bit 0 for 37 to bit 2 for 39\n"
+		"  -t  simulated time per parameter set in seconds\n"
+		"  -s  random seed\n"
+		"  -x  probability of losing a beacon that did not collide\n"
+		"  -d  clock drift bound of the nodes in ppm\n"
+		"  -o  check B-BLEnd two-way discovery within one epoch for two nodes, at boot offsets\n"
+		"      this many ms apart over one epoch; the status is 1 if it fails at any\n"
+		"  -c  print the latency CDF in 5 %% steps\n"
+		"  -v  print the firmware log, repeat for more\n",
+		prog);
+}
+
+static int parse_phy(const char *s, enum blend_phy *phy)
+{
+	if (!strcmp(s, "1m")) {
+		*phy = BLEND_PHY_1M;
+	} else if (!strcmp(s, "2m")) {
+		*phy = BLEND_PHY_2M;
+	} else if (!strcmp(s, "coded")) {
+		*phy = BLEND_PHY_CODED;
+	} else {
+		return -EINVAL;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct sim_set sets[SETS_MAX];
+	int set_count = 0;
+	int opt, err, failed = 0;
+
+	while ((opt = getopt(argc, argv, "n:p:l:P:N:by:C:t:s:x:d:o:cvh")) != -1) {
+		switch (opt) {
+		case 'n':
+			opts.nodes = strtol(optarg, NULL, 10);
+			break;
+		case 'p': {
+			unsigned long e, a;
+
+			if (set_count == SETS_MAX || sscanf(optarg, "%lu:%lu", &e, &a) != 2 ||
+			    a == 0 || a > UINT16_MAX) {
+				usage(argv[0]);
+				return 2;
+			}
+			sets[set_count++] = (struct sim_set){ .epoch_ms = e, .adv_interval = a };
+			break;
+		}
+		case 'l':
+			opts.latency_ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'P':
+			opts.probability = strtof(optarg, NULL);
+			break;
+		case 'N':
+			opts.neighbors = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			opts.mode = BLEND_MODE_BIDIRECTIONAL;
+			break;
+		case 'y':
+			if (parse_phy(optarg, &opts.phy)) {
+				usage(argv[0]);
+				return 2;
+			}
+			break;
+		case 'C':
+			opts.channels = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			opts.seconds = strtod(optarg, NULL);
+			break;
+		case 's':
+			opts.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'x':
+			sim_radio.loss = strtod(optarg, NULL);
+			break;
+		case 'd':
+			opts.drift_ppm = strtod(optarg, NULL);
+			break;
+		case 'o':
+			opts.sweep_ms = strtoul(optarg, NULL, 10);
+			opts.mode = BLEND_MODE_BIDIRECTIONAL;
+			break;
+		case 'c':
+			opts.cdf = true;
+			break;
+		case 'v':
+			sim_verbosity++;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (opts.nodes < 2 || opts.seconds <= 0 || opts.channels == 0 || (opts.channels & ~BLEND_CHAN_ALL)) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (opts.sweep_ms) {
+		opts.nodes = 2;
+	}
+
+	if (set_count == 0) {
+		// the targets of demo/src/main.c, for the simulated number of nodes
+		struct blend_opt_target target = {
+			.latency_ms = opts.latency_ms ? opts.latency_ms : 30000,
+			.probability = opts.probability,
+			.neighbors = opts.neighbors ? opts.neighbors : MIN(opts.nodes, UINT16_MAX),
+			.bidirectional = opts.mode == BLEND_MODE_BIDIRECTIONAL,
+			.radio.channels = POPCOUNT(opts.channels),
+		};
+		struct blend_opt_result result;
+
+		err = blend_opt_solve(&target, &result);
+		if (err) {
+			fprintf(stderr, "%s\n", err == -ENOENT ? "no (E, A) pair meets the target" : "invalid target");
+			return 1;
+		}
+		opts.latency_ms = target.latency_ms;
+		sets[set_count++] = (struct sim_set){ .epoch_ms = result.epoch_ms,
+						      .adv_interval = result.adv_interval };
+	}
+
+	err = sim_init(opts.nodes);
+	heard = malloc((size_t)opts.nodes * opts.nodes * sizeof(*heard));
+	if (err || !heard) {
+		fprintf(stderr, "out of memory for %d nodes\n", opts.nodes);
+		return 1;
+	}
+	for (int i = 0; i < set_count; i++) {
+		if (opts.sweep_ms) {
+			failed += sweep(&sets[i]);
+		} else {
+			run(&sets[i]);
+		}
+	}
+	free(heard);
+	sim_free();
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,724 @@
+#include "sim.h"
+#include "blend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Radio model
+ * Every node is in range of every other. An advertising event puts one PDU on each enabled
+ * primary channel, CONFIG_BLEND_ADV_CHANNEL_GAP_US apart. Extended events follow them with one
+ * AUX_ADV_IND on a random data channel, which carries the payload. The next event starts one
+ * interval plus a random advDelay of 0 to 10 ms later.
+ * Two PDUs on the same channel that overlap in time are both lost. A scanner hears a PDU when it
+ * scans on the PDU's channel and primary PHY for the whole PDU and is not transmitting at the same
+ * time; for extended events it must also hear the AUX_ADV_IND. The scanner starts on channel 37
+ * and moves to the next primary channel after every scan interval.
+ */
+
+#define PDU_RING 262144    /* PDUs that can be on air at once, a power of two */
+#define AIR_RING 65536     /* advertising events that can be on air at once, a power of two */
+#define PRIMARY_MAX 3
+#define CHANNELS 40
+/* a scanner is checked for receptions this long after its window ended */
+#define SCAN_LINGER_US 20000
+
+/* PDU layout, as in advertiser_scanner.c */
+#define ADV_ADDR_LEN 6
+#define ADV_EXT_IND_LEN 7
+#define ADV_AUX_HDR_LEN 10
+
+BUILD_ASSERT(IS_POWER_OF_TWO(PDU_RING) && IS_POWER_OF_TWO(AIR_RING), "rings must be powers of two");
+
+struct sim_pdu {
+	int64_t start_us, end_us;
+	uint8_t chan;
+	bool coded;
+	bool collided;
+};
+
+/* one advertising event on air */
+struct sim_air {
+	int32_t node;
+	uint8_t prim_count;
+	bool ext;
+	uint32_t prim[PRIMARY_MAX];
+	uint32_t aux;
+	uint8_t data[SIM_ADV_DATA_MAX];
+	uint8_t data_len;
+};
+
+/* PDUs on air per channel, as indices into the PDU ring */
+struct sim_channel {
+	uint32_t *pdus;
+	size_t len, cap;
+};
+
+struct sim_radio_config sim_radio = {
+	.rssi = -60,
+};
+
+static struct sim_pdu *pdus;
+static uint32_t pdu_next;
+static struct sim_air *airs;
+static uint32_t air_next;
+static struct sim_channel channels[CHANNELS];
+/* nodes whose scan windows may hold a reception */
+static int *scanners;
+static int scanner_count;
+static struct sim_radio_stats stats;
+
+int sim_radio_init(int nodes)
+{
+	pdus = calloc(PDU_RING, sizeof(*pdus));
+	airs = calloc(AIR_RING, sizeof(*airs));
+	scanners = calloc(nodes, sizeof(*scanners));
+	if (!pdus || !airs || !scanners) {
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void sim_radio_reset(void)
+{
+	for (int c = 0; c < CHANNELS; c++) {
+		channels[c].len = 0;
+	}
+	scanner_count = 0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+void sim_radio_free(void)
+{
+	for (int c = 0; c < CHANNELS; c++) {
+		free(channels[c].pdus);
+	}
+	free(pdus);
+	free(airs);
+	free(scanners);
+}
+
+void sim_radio_stats_get(struct sim_radio_stats *out)
+{
+	*out = stats;
+}
+
+/**
+ * @brief Returns the on-air time of one PDU, header and CRC included
+ *
+ * Same timing as adv_pdu_us in advertiser_scanner.c.
+ */
+static uint32_t pdu_us(enum blend_phy phy, size_t len)
+{
+	switch (phy) {
+	case BLEND_PHY_2M:
+		return (2 + 4 + 2 + len + 3) * 4;
+	case BLEND_PHY_CODED:
+		return 376 + (2 + len + 3) * 64 + 24;
+	default:
+		return (1 + 4 + 2 + len + 3) * 8;
+	}
+}
+
+/**
+ * @brief Puts a PDU on air and marks it and every PDU it overlaps as collided
+ *
+ * Every PDU that can overlap the new one was put on air before it, since advertising events are
+ * laid out when they start and a PDU never starts before its event.
+ *
+ * @return Index of the PDU in the ring
+ */
+static uint32_t pdu_send(uint8_t chan, int64_t start_us, uint32_t len_us, bool coded)
+{
+	struct sim_channel *ch = &channels[chan];
+	uint32_t id = pdu_next++;
+	struct sim_pdu *pdu = &pdus[id & (PDU_RING - 1)];
+	size_t kept = 0;
+
+	pdu->start_us = start_us;
+	pdu->end_us = start_us + len_us;
+	pdu->chan = chan;
+	pdu->coded = coded;
+	pdu->collided = false;
+	for (size_t i = 0; i < ch->len; i++) {
+		struct sim_pdu *other = &pdus[ch->pdus[i] & (PDU_RING - 1)];
+
+		if (other->end_us < sim_now_us()) {
+			continue; // off air, drop it from the channel
+		}
+		ch->pdus[kept++] = ch->pdus[i];
+		if (other->start_us < pdu->end_us && pdu->start_us < other->end_us) {
+			stats.collided += !other->collided + !pdu->collided;
+			other->collided = true;
+			pdu->collided = true;
+		}
+	}
+	ch->len = kept;
+	if (ch->len == ch->cap) {
+		ch->cap = ch->cap ? ch->cap * 2 : 64;
+		ch->pdus = realloc(ch->pdus, ch->cap * sizeof(*ch->pdus));
+		if (!ch->pdus) {
+			fprintf(stderr, "out of memory for channel %u\n", chan);
+			exit(1);
+		}
+	}
+	ch->pdus[ch->len++] = id;
+	stats.pdus++;
+	return id;
+}
+
+/**
+ * @brief Sends one advertising event of a node and schedules the end of each reception
+ */
+static void adv_event_send(struct sim_node *node)
+{
+	struct sim_adv *adv = &node->adv;
+	uint32_t id = air_next++ & (AIR_RING - 1);
+	struct sim_air *air = &airs[id];
+	bool coded = adv->options & BT_LE_ADV_OPT_CODED;
+	enum blend_phy prim_phy = coded ? BLEND_PHY_CODED : BLEND_PHY_1M;
+	enum blend_phy aux_phy = coded ? BLEND_PHY_CODED :
+			       (adv->options & BT_LE_ADV_OPT_NO_2M) ? BLEND_PHY_1M : BLEND_PHY_2M;
+	uint32_t prim_len;
+	int64_t t = sim_now_us();
+
+	air->node = node->id;
+	air->ext = adv->options & BT_LE_ADV_OPT_EXT_ADV;
+	air->prim_count = 0;
+	air->data_len = adv->data_len;
+	memcpy(air->data, adv->data, adv->data_len);
+	prim_len = air->ext ? pdu_us(prim_phy, ADV_EXT_IND_LEN) :
+			      pdu_us(BLEND_PHY_1M, ADV_ADDR_LEN + adv->data_len);
+
+	node->tx_start_us[1] = node->tx_start_us[0];
+	node->tx_end_us[1] = node->tx_end_us[0];
+	node->tx_start_us[0] = t;
+	for (int i = 0; i < PRIMARY_MAX; i++) {
+		struct sim_pdu *pdu;
+
+		if (adv->options & (BT_LE_ADV_OPT_DISABLE_CHAN_37 << i)) {
+			continue;
+		}
+		if (air->prim_count > 0) {
+			t += CONFIG_BLEND_ADV_CHANNEL_GAP_US;
+		}
+		air->prim[air->prim_count] = pdu_send(37 + i, t, prim_len, coded);
+		pdu = &pdus[air->prim[air->prim_count] & (PDU_RING - 1)];
+		if (!air->ext) {
+			sim_schedule(pdu->end_us, SIM_EV_RX, node->id, NULL, id << 2 | air->prim_count);
+		}
+		air->prim_count++;
+		t += prim_len;
+		node->tx_us += prim_len;
+	}
+	if (air->ext) {
+		uint32_t aux_len = pdu_us(aux_phy, ADV_AUX_HDR_LEN + adv->data_len);
+
+		t += CONFIG_BLEND_ADV_AUX_GAP_US;
+		air->aux = pdu_send(sim_random() % 37, t, aux_len, coded);
+		t += aux_len;
+		node->tx_us += aux_len;
+		sim_schedule(t, SIM_EV_RX, node->id, NULL, id << 2 | PRIMARY_MAX);
+	}
+	node->tx_end_us[0] = t;
+	node->adv_events++;
+}
+
+/**
+ * @brief Returns the primary channel a scanner listens on at a time, 0 between scan windows
+ */
+static uint8_t scan_channel(const struct sim_scan *scan, int64_t t)
+{
+	int64_t interval_us = scan->param.interval * 625LL;
+	int64_t n;
+
+	if (t < scan->start_us || t >= scan->end_us) {
+		return 0;
+	}
+	n = (t - scan->start_us) / interval_us;
+	if (t - scan->start_us - n * interval_us >= scan->param.window * 625LL) {
+		return 0;
+	}
+	return 37 + n % 3;
+}
+
+/**
+ * @brief Tells whether a node sends an advertising event during a span of time
+ */
+static bool node_transmits(const struct sim_node *node, int64_t start_us, int64_t end_us)
+{
+	for (int i = 0; i < 2; i++) {
+		if (node->tx_start_us[i] < end_us && start_us < node->tx_end_us[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Tells whether a scanner hears a primary PDU
+ */
+static bool scan_hears(const struct sim_node *node, const struct sim_pdu *pdu)
+{
+	const struct sim_scan *scan = &node->scan;
+	bool scan_coded = scan->param.options & BT_LE_SCAN_OPT_CODED;
+	bool scan_1m = !(scan->param.options & BT_LE_SCAN_OPT_NO_1M);
+
+	if (pdu->coded ? !scan_coded : !scan_1m) {
+		return false;
+	}
+	if (scan_channel(scan, pdu->start_us) != pdu->chan ||
+	    scan_channel(scan, pdu->end_us - 1) != pdu->chan) {
+		return false;
+	}
+	// half duplex: nothing is heard during our own advertising events
+	return !node_transmits(node, pdu->start_us, pdu->end_us);
+}
+
+/**
+ * @brief Tells whether a payload passes the manufacturer data filter of a scanner
+ */
+static bool scan_filter(const struct sim_scan *scan, const uint8_t *data, size_t len)
+{
+	size_t i = 0;
+
+	if (!scan->filter_on) {
+		return true;
+	}
+	while (i + 1 < len && data[i] != 0) {
+		uint8_t ad_len = data[i];
+
+		if (i + 1 + ad_len > len) {
+			return false;
+		}
+		if (data[i + 1] == BT_DATA_MANUFACTURER_DATA && ad_len - 1 >= scan->filter_len &&
+		    memcmp(&data[i + 2], scan->filter, scan->filter_len) == 0) {
+			return true;
+		}
+		i += 1 + ad_len;
+	}
+	return false;
+}
+
+/**
+ * @brief Hands a received beacon to the scan callback of a node
+ */
+static void scan_deliver(struct sim_node *node, const struct sim_node *sender,
+			 const struct sim_air *air)
+{
+	static uint8_t data[SIM_ADV_DATA_MAX];
+	struct bt_le_scan_recv_info info = {
+		.addr = &sender->addr,
+		.sid = air->ext ? 0 : BT_GAP_SID_INVALID,
+		.rssi = sim_radio.rssi,
+		.tx_power = 0,
+		.adv_type = air->ext ? BT_GAP_ADV_TYPE_EXT_ADV : BT_GAP_ADV_TYPE_ADV_NONCONN_IND,
+		.adv_props = air->ext ? BT_GAP_ADV_PROP_EXT_ADV : 0,
+	};
+	struct net_buf_simple buf;
+	struct bt_scan_device_info device_info = {
+		.recv_info = &info,
+		.adv_data = &buf,
+	};
+	struct bt_scan_filter_match match = { 0 };
+
+	if (!node->scan.cb || !node->scan.cb->cb_addr.filter_match ||
+	    !scan_filter(&node->scan, air->data, air->data_len)) {
+		return;
+	}
+	if (sim_radio.loss > 0 && sim_random_unit() < sim_radio.loss) {
+		return;
+	}
+	memcpy(data, air->data, air->data_len);
+	net_buf_simple_init_with_data(&buf, data, air->data_len);
+	match.manufacturer_data.match = node->scan.filter_on;
+	stats.received++;
+	node->rx_count++;
+	sim_node_enter(node);
+	node->scan.cb->cb_addr.filter_match(&device_info, &match, false);
+	sim_heard(node, sender);
+}
+
+/**
+ * @brief Decides which scanners heard a transmission that has just ended
+ *
+ * @param sender Node that sent the advertising event
+ * @param arg Air record of the event and the primary PDU that ended, or PRIMARY_MAX for the
+ *            auxiliary PDU of an extended event
+ */
+static void rx_end(struct sim_node *sender, uint32_t arg)
+{
+	const struct sim_air *air = &airs[arg >> 2];
+	uint32_t which = arg & 3;
+	const struct sim_pdu *aux = air->ext ? &pdus[air->aux & (PDU_RING - 1)] : NULL;
+
+	if (aux && aux->collided) {
+		return;
+	}
+	for (int i = 0; i < scanner_count; i++) {
+		struct sim_node *node = &sim_nodes[scanners[i]];
+
+		if (!node->scan.running && node->scan.end_us < sim_now_us() - SCAN_LINGER_US) {
+			// the window is long over: take the scanner off the list
+			node->scan.listed = false;
+			scanners[i--] = scanners[--scanner_count];
+			continue;
+		}
+		if (node == sender) {
+			continue;
+		}
+		for (int p = 0; p < air->prim_count; p++) {
+			const struct sim_pdu *pdu = &pdus[air->prim[p] & (PDU_RING - 1)];
+
+			if ((!aux && (uint32_t)p != which) || pdu->collided) {
+				continue;
+			}
+			if (!scan_hears(node, pdu)) {
+				continue;
+			}
+			// the scanner follows the AuxPtr to the data channel until the end of the AUX_ADV_IND
+			if (aux && (node->scan.end_us < aux->end_us ||
+				    node_transmits(node, aux->start_us, aux->end_us))) {
+				continue;
+			}
+			scan_deliver(node, sender, air);
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Runs the next advertising event of a node, or ends its window
+ */
+static void adv_event(struct sim_node *node, uint32_t gen)
+{
+	struct sim_adv *adv = &node->adv;
+	int64_t next_us;
+
+	if (!adv->running || adv->gen != gen) {
+		return;
+	}
+	adv_event_send(node);
+	if (sim_radio.overlap) {
+		// two beacons that overlap in time collide in BLEnd's model, on any channels
+		for (int i = 0; i < sim_node_count; i++) {
+			if (i != node->id &&
+			    node_transmits(&sim_nodes[i], node->tx_start_us[0], node->tx_end_us[0])) {
+				stats.overlapped++;
+			}
+		}
+	}
+	adv->sent++;
+	if (adv->num_events && adv->sent >= adv->num_events) {
+		sim_schedule(node->tx_end_us[0], SIM_EV_ADV_END, node->id, NULL, gen);
+		return;
+	}
+	next_us = sim_now_us() + adv->interval * 625LL + sim_random() % (BLEND_ADV_DELAY_MAX_US + 1);
+	if (adv->end_us && next_us >= adv->end_us) {
+		sim_schedule(adv->end_us, SIM_EV_ADV_END, node->id, NULL, gen);
+		return;
+	}
+	sim_schedule(next_us, SIM_EV_ADV, node->id, NULL, gen);
+}
+
+/**
+ * @brief Ends the advertising window of a node and notifies its host
+ */
+static void adv_end(struct sim_node *node, uint32_t gen)
+{
+	struct sim_adv *adv = &node->adv;
+	struct bt_le_ext_adv_sent_info info = {
+		.num_sent = adv->sent,
+	};
+
+	if (!adv->running || adv->gen != gen) {
+		return;
+	}
+	adv->running = false;
+	adv->gen++;
+	sim_node_enter(node);
+	if (adv->cb && adv->cb->sent) {
+		adv->cb->sent((struct bt_le_ext_adv *)node, &info);
+	}
+}
+
+static void scan_end(struct sim_node *node)
+{
+	struct sim_scan *scan = &node->scan;
+
+	scan->running = false;
+	scan->gen++;
+	scan->end_us = sim_now_us();
+	node->scan_us += scan->end_us - scan->start_us;
+}
+
+void sim_radio_event(struct sim_node *node, enum sim_event_type type, uint32_t arg)
+{
+	switch (type) {
+	case SIM_EV_ADV:
+		adv_event(node, arg);
+		break;
+	case SIM_EV_ADV_END:
+		adv_end(node, arg);
+		break;
+	case SIM_EV_RX:
+		rx_end(node, arg);
+		break;
+	case SIM_EV_SCAN_TIMEOUT:
+		if (!node->scan.running || node->scan.gen != arg) {
+			break;
+		}
+		scan_end(node);
+		sim_schedule(sim_now_us() + SIM_HCI_LATENCY_US, SIM_EV_SCAN_CB, node->id, NULL, 0);
+		break;
+	case SIM_EV_SCAN_CB:
+		sim_node_enter(node);
+		if (node->scan.timeout_cb && node->scan.timeout_cb->timeout) {
+			node->scan.timeout_cb->timeout();
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void sim_radio_finish(int64_t end_us)
+{
+	for (int i = 0; i < sim_node_count; i++) {
+		struct sim_node *node = &sim_nodes[i];
+
+		if (node->scan.running) {
+			node->scan_us += end_us - node->scan.start_us;
+			node->scan.start_us = end_us;
+		}
+	}
+}
+
+/* Bluetooth host shim, for the running node */
+
+void bt_id_get(bt_addr_le_t *addrs, size_t *count)
+{
+	if (*count > 0) {
+		bt_addr_le_copy(&addrs[0], &sim_node_current()->addr);
+		*count = 1;
+	}
+}
+
+int bt_addr_le_to_str(const bt_addr_le_t *addr, char *str, size_t len)
+{
+	return snprintf(str, len, "%02X:%02X:%02X:%02X:%02X:%02X (%s)", addr->a.val[5],
+			addr->a.val[4], addr->a.val[3], addr->a.val[2], addr->a.val[1], addr->a.val[0],
+			addr->type == BT_ADDR_LE_PUBLIC ? "public" : "random");
+}
+
+void net_buf_simple_init_with_data(struct net_buf_simple *buf, void *data, size_t size)
+{
+	buf->data = data;
+	buf->len = size;
+	buf->size = size;
+}
+
+void bt_data_parse(struct net_buf_simple *ad, bool (*func)(struct bt_data *data, void *user_data),
+		   void *user_data)
+{
+	size_t i = 0;
+
+	while (i + 1 < ad->len && ad->data[i] != 0 && i + 1 + ad->data[i] <= ad->len) {
+		struct bt_data data = {
+			.type = ad->data[i + 1],
+			.data_len = ad->data[i] - 1,
+			.data = &ad->data[i + 2],
+		};
+
+		if (!func(&data, user_data)) {
+			return;
+		}
+		i += 1 + ad->data[i];
+	}
+}
+
+int bt_le_ext_adv_create(const struct bt_le_adv_param *param, const struct bt_le_ext_adv_cb *cb,
+			 struct bt_le_ext_adv **out)
+{
+	struct sim_node *node = sim_node_current();
+
+	node->adv.created = true;
+	node->adv.options = param->options;
+	node->adv.interval = param->interval_min;
+	node->adv.cb = cb;
+	*out = (struct bt_le_ext_adv *)node;
+	return 0;
+}
+
+int bt_le_ext_adv_start(struct bt_le_ext_adv *set, const struct bt_le_ext_adv_start_param *param)
+{
+	struct sim_adv *adv = &sim_node_current()->adv;
+
+	if (!adv->created) {
+		return -EINVAL;
+	}
+	if (adv->running) {
+		return -EALREADY;
+	}
+	adv->running = true;
+	adv->gen++;
+	adv->sent = 0;
+	adv->num_events = param->num_events;
+	adv->end_us = param->timeout ? sim_now_us() + param->timeout * 10000LL : 0;
+	sim_schedule(sim_now_us() + SIM_ADV_START_US, SIM_EV_ADV, sim_node_current()->id, NULL,
+		     adv->gen);
+	return 0;
+}
+
+int bt_le_ext_adv_stop(struct bt_le_ext_adv *set)
+{
+	struct sim_adv *adv = &sim_node_current()->adv;
+
+	adv->running = false;
+	adv->gen++;
+	return 0;
+}
+
+int bt_le_ext_adv_set_data(struct bt_le_ext_adv *set, const struct bt_data *ad, size_t ad_len,
+			   const struct bt_data *sd, size_t sd_len)
+{
+	struct sim_adv *adv = &sim_node_current()->adv;
+	size_t max = (adv->options & BT_LE_ADV_OPT_EXT_ADV) ? SIM_ADV_DATA_MAX :
+							       BT_GAP_ADV_MAX_ADV_DATA_LEN;
+	size_t len = 0;
+
+	for (size_t i = 0; i < ad_len; i++) {
+		len += 2 + ad[i].data_len;
+	}
+	if (len > max) {
+		return -EINVAL;
+	}
+	len = 0;
+	for (size_t i = 0; i < ad_len; i++) {
+		adv->data[len++] = ad[i].data_len + 1;
+		adv->data[len++] = ad[i].type;
+		memcpy(&adv->data[len], ad[i].data, ad[i].data_len);
+		len += ad[i].data_len;
+	}
+	adv->data_len = len;
+	return 0;
+}
+
+int bt_le_ext_adv_update_param(struct bt_le_ext_adv *set, const struct bt_le_adv_param *param)
+{
+	struct sim_adv *adv = &sim_node_current()->adv;
+
+	if (adv->running) {
+		return -EINVAL;
+	}
+	adv->options = param->options;
+	adv->interval = param->interval_min;
+	return 0;
+}
+
+int bt_le_per_adv_set_param(struct bt_le_ext_adv *adv, const struct bt_le_per_adv_param *param)
+{
+	return -ENOTSUP;
+}
+
+int bt_le_per_adv_set_data(const struct bt_le_ext_adv *adv, const struct bt_data *ad, size_t ad_len)
+{
+	return -ENOTSUP;
+}
+
+int bt_le_per_adv_start(struct bt_le_ext_adv *adv)
+{
+	return -ENOTSUP;
+}
+
+int bt_le_per_adv_stop(struct bt_le_ext_adv *adv)
+{
+	return -ENOTSUP;
+}
+
+void bt_scan_init(const struct bt_scan_init_param *init)
+{
+	if (init && init->scan_param) {
+		sim_node_current()->scan.param = *init->scan_param;
+	}
+}
+
+void bt_scan_cb_register(struct bt_scan_cb *cb)
+{
+	sim_node_current()->scan.cb = cb;
+}
+
+int bt_le_scan_cb_register(struct bt_le_scan_cb *cb)
+{
+	sim_node_current()->scan.timeout_cb = cb;
+	return 0;
+}
+
+int bt_scan_params_set(struct bt_le_scan_param *scan_param)
+{
+	sim_node_current()->scan.param = *scan_param;
+	return 0;
+}
+
+int bt_scan_filter_add(enum bt_scan_filter_type type, const void *data)
+{
+	const struct bt_scan_manufacturer_data *mfg = data;
+	struct sim_scan *scan = &sim_node_current()->scan;
+
+	if (type != BT_SCAN_FILTER_TYPE_MANUFACTURER_DATA) {
+		return -ENOTSUP;
+	}
+	if (mfg->data_len > sizeof(scan->filter)) {
+		return -EINVAL;
+	}
+	memcpy(scan->filter, mfg->data, mfg->data_len);
+	scan->filter_len = mfg->data_len;
+	return 0;
+}
+
+void bt_scan_filter_remove_all(void)
+{
+	sim_node_current()->scan.filter_len = 0;
+}
+
+int bt_scan_filter_enable(uint8_t mode, bool match_all)
+{
+	sim_node_current()->scan.filter_on = mode & BT_SCAN_MANUFACTURER_DATA_FILTER;
+	return 0;
+}
+
+int bt_scan_start(enum bt_scan_type scan_type)
+{
+	struct sim_node *node = sim_node_current();
+	struct sim_scan *scan = &node->scan;
+
+	if (scan->running) {
+		return -EALREADY;
+	}
+	if (scan->param.interval == 0 || scan->param.window > scan->param.interval) {
+		return -EINVAL;
+	}
+	scan->running = true;
+	scan->gen++;
+	scan->start_us = sim_now_us();
+	scan->end_us = INT64_MAX;
+	if (!scan->listed) {
+		scan->listed = true;
+		scanners[scanner_count++] = node->id;
+	}
+	if (scan->param.timeout) {
+		sim_schedule(sim_now_us() + scan->param.timeout * 10000LL, SIM_EV_SCAN_TIMEOUT, node->id,
+			     NULL, scan->gen);
+	}
+	return 0;
+}
+
+int bt_scan_stop(void)
+{
+	struct sim_node *node = sim_node_current();
+
+	if (!node->scan.running) {
+		return -EALREADY;
+	}
+	scan_end(node);
+	return 0;
+}
@@ -0,0 +1,352 @@
+#include "sim.h"
+
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Node images
+ * CMake renames the .data and .bss sections of the BLEnd objects, so the linker brackets the
+ * static variables of the firmware with these symbols. The region holds the variables of the
+ * node that is running; entering another node saves the region to the image of the running node
+ * and loads the image of the next one. Every node sees its variables at the same addresses, so
+ * pointers the firmware keeps into its own variables stay valid across swaps.
+ */
+extern uint8_t __start_sim_node_data[], __stop_sim_node_data[];
+extern uint8_t __start_sim_node_bss[], __stop_sim_node_bss[];
+
+#define SIM_DATA_LEN ((size_t)(__stop_sim_node_data - __start_sim_node_data))
+#define SIM_BSS_LEN ((size_t)(__stop_sim_node_bss - __start_sim_node_bss))
+
+struct sim_event {
+	int64_t t_us;
+	uint64_t seq; /* events at the same time run in the order they were scheduled */
+	void *obj;
+	int32_t node;
+	uint32_t arg;
+	enum sim_event_type type;
+};
+
+struct sim_node *sim_nodes;
+int sim_node_count;
+int sim_verbosity = LOG_LEVEL_ERR;
+
+/* initial values of the firmware variables, copied before any node runs */
+static uint8_t *pristine;
+static struct sim_node *current;
+static int64_t now_us;
+static uint64_t seq;
+static uint64_t rng_state;
+
+/* binary min-heap on (t_us, seq) */
+static struct sim_event *heap;
+static size_t heap_len, heap_cap;
+
+static bool event_before(const struct sim_event *a, const struct sim_event *b)
+{
+	return a->t_us < b->t_us || (a->t_us == b->t_us && a->seq < b->seq);
+}
+
+void sim_schedule(int64_t t_us, enum sim_event_type type, int node, void *obj, uint32_t arg)
+{
+	struct sim_event ev = {
+		.t_us = MAX(t_us, now_us),
+		.seq = seq++,
+		.obj = obj,
+		.node = node,
+		.arg = arg,
+		.type = type,
+	};
+	size_t i;
+
+	if (heap_len == heap_cap) {
+		heap_cap = heap_cap ? heap_cap * 2 : 1024;
+		heap = realloc(heap, heap_cap * sizeof(*heap));
+		if (!heap) {
+			fprintf(stderr, "out of memory for %zu events\n", heap_cap);
+			exit(1);
+		}
+	}
+	for (i = heap_len++; i > 0 && event_before(&ev, &heap[(i - 1) / 2]); i = (i - 1) / 2) {
+		heap[i] = heap[(i - 1) / 2];
+	}
+	heap[i] = ev;
+}
+
+static struct sim_event event_pop(void)
+{
+	struct sim_event top = heap[0];
+	struct sim_event last = heap[--heap_len];
+	size_t i = 0, child;
+
+	while ((child = 2 * i + 1) < heap_len) {
+		if (child + 1 < heap_len && event_before(&heap[child + 1], &heap[child])) {
+			child++;
+		}
+		if (!event_before(&heap[child], &last)) {
+			break;
+		}
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+	return top;
+}
+
+int64_t sim_now_us(void)
+{
+	return now_us;
+}
+
+struct sim_node *sim_node_current(void)
+{
+	return current;
+}
+
+void sim_node_enter(struct sim_node *node)
+{
+	if (node == current) {
+		return;
+	}
+	if (current) {
+		memcpy(current->image, __start_sim_node_data, SIM_DATA_LEN);
+		memcpy(current->image + SIM_DATA_LEN, __start_sim_node_bss, SIM_BSS_LEN);
+	}
+	memcpy(__start_sim_node_data, node->image, SIM_DATA_LEN);
+	memcpy(__start_sim_node_bss, node->image + SIM_DATA_LEN, SIM_BSS_LEN);
+	current = node;
+}
+
+int64_t sim_local_us(const struct sim_node *node)
+{
+	return (int64_t)((double)(now_us - node->boot_us) * (1.0 + node->drift));
+}
+
+int64_t sim_local_to_global_us(const struct sim_node *node, int64_t local_us)
+{
+	double t = (double)local_us / (1.0 + node->drift);
+
+	return node->boot_us + (int64_t)t + ((double)(int64_t)t < t);
+}
+
+/* xorshift64*, so a seed reproduces a run on any host */
+uint64_t sim_random(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+double sim_random_unit(void)
+{
+	return (sim_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int sim_init(int nodes)
+{
+	size_t image_len = SIM_DATA_LEN + SIM_BSS_LEN;
+
+	sim_nodes = calloc(nodes, sizeof(*sim_nodes));
+	pristine = malloc(image_len);
+	if (!sim_nodes || !pristine) {
+		return -ENOMEM;
+	}
+	memcpy(pristine, __start_sim_node_data, SIM_DATA_LEN);
+	memcpy(pristine + SIM_DATA_LEN, __start_sim_node_bss, SIM_BSS_LEN);
+	for (int i = 0; i < nodes; i++) {
+		sim_nodes[i].image = malloc(image_len);
+		if (!sim_nodes[i].image) {
+			return -ENOMEM;
+		}
+	}
+	sim_node_count = nodes;
+	return sim_radio_init(nodes);
+}
+
+void sim_reset(uint64_t seed)
+{
+	size_t image_len = SIM_DATA_LEN + SIM_BSS_LEN;
+
+	for (int i = 0; i < sim_node_count; i++) {
+		struct sim_node *n = &sim_nodes[i];
+		uint8_t *image = n->image;
+
+		memset(n, 0, sizeof(*n));
+		n->id = i;
+		n->image = image;
+		memcpy(n->image, pristine, image_len);
+		// random static identity address, unique per node
+		n->addr.type = BT_ADDR_LE_RANDOM;
+		sys_put_le32(i, n->addr.a.val);
+		n->addr.a.val[5] = 0xC0;
+	}
+	current = NULL;
+	now_us = 0;
+	rng_state = seed ? seed : 1;
+	heap_len = 0;
+	sim_radio_reset();
+}
+
+void sim_run(int64_t until_us)
+{
+	while (heap_len > 0 && heap[0].t_us <= until_us) {
+		struct sim_event ev = event_pop();
+		struct sim_node *node = &sim_nodes[ev.node];
+
+		now_us = ev.t_us;
+		switch (ev.type) {
+		case SIM_EV_BOOT:
+			sim_node_enter(node);
+			sim_node_boot(node);
+			break;
+		case SIM_EV_TIMER: {
+			struct k_timer *timer = ev.obj;
+
+			sim_node_enter(node);
+			if (!timer->running || timer->gen != ev.arg) {
+				break;
+			}
+			if (timer->period > 0) {
+				k_timer_start(timer, K_TICKS(timer->period), K_TICKS(timer->period));
+			} else {
+				timer->running = false;
+			}
+			timer->expiry_fn(timer);
+			break;
+		}
+		case SIM_EV_WORK: {
+			struct k_work *work = ev.obj;
+
+			sim_node_enter(node);
+			if (!work->pending || work->gen != ev.arg) {
+				break;
+			}
+			work->pending = false;
+			work->handler(work);
+			break;
+		}
+		default:
+			sim_radio_event(node, ev.type, ev.arg);
+			break;
+		}
+	}
+	now_us = MAX(now_us, until_us);
+}
+
+void sim_free(void)
+{
+	sim_radio_free();
+	for (int i = 0; i < sim_node_count; i++) {
+		free(sim_nodes[i].image);
+	}
+	free(sim_nodes);
+	free(pristine);
+	free(heap);
+}
+
+void sim_log(int level, const char *fmt, ...)
+{
+	static const char *const names[] = { "", "err", "wrn", "inf", "dbg" };
+	va_list ap;
+
+	if (level > sim_verbosity) {
+		return;
+	}
+	printf("[%12.6f] node %4d %s: ", now_us / 1e6, current ? current->id : -1, names[level]);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	putchar('\n');
+}
+
+/* kernel shim, on the clock of the running node */
+
+k_ticks_t k_uptime_ticks(void)
+{
+	return sim_local_us(current) * CONFIG_SYS_CLOCK_TICKS_PER_SEC / USEC_PER_SEC;
+}
+
+uint32_t k_cycle_get_32(void)
+{
+	return (uint32_t)sim_local_us(current);
+}
+
+void k_timer_init(struct k_timer *timer, k_timer_expiry_t expiry_fn, k_timer_expiry_t stop_fn)
+{
+	memset(timer, 0, sizeof(*timer));
+	timer->expiry_fn = expiry_fn;
+	timer->stop_fn = stop_fn;
+}
+
+void k_timer_start(struct k_timer *timer, k_timeout_t duration, k_timeout_t period)
+{
+	k_ticks_t ticks = duration.ticks;
+	int64_t local_us;
+
+	if (duration.ticks == K_TICKS_FOREVER) {
+		k_timer_stop(timer);
+		return;
+	}
+	if (!duration.abs) {
+		ticks += k_uptime_ticks();
+	}
+	local_us = DIV_ROUND_UP(ticks * USEC_PER_SEC, CONFIG_SYS_CLOCK_TICKS_PER_SEC);
+	timer->gen++;
+	timer->running = true;
+	timer->period = period.ticks == K_TICKS_FOREVER ? 0 : period.ticks;
+	sim_schedule(sim_local_to_global_us(current, local_us), SIM_EV_TIMER, current->id, timer,
+		     timer->gen);
+}
+
+void k_timer_stop(struct k_timer *timer)
+{
+	bool running = timer->running;
+
+	timer->gen++;
+	timer->running = false;
+	if (running && timer->stop_fn) {
+		timer->stop_fn(timer);
+	}
+}
+
+void k_work_init(struct k_work *work, k_work_handler_t handler)
+{
+	memset(work, 0, sizeof(*work));
+	work->handler = handler;
+}
+
+int k_work_submit(struct k_work *work)
+{
+	if (work->pending) {
+		return 0;
+	}
+	work->pending = true;
+	sim_schedule(now_us + SIM_WORK_LATENCY_US, SIM_EV_WORK, current->id, work, work->gen);
+	return 1;
+}
+
+int k_work_submit_to_queue(struct k_work_q *queue, struct k_work *work)
+{
+	ARG_UNUSED(queue);
+	return k_work_submit(work);
+}
+
+bool k_work_cancel(struct k_work *work)
+{
+	work->gen++;
+	work->pending = false;
+	return false;
+}
+
+void k_work_queue_start(struct k_work_q *queue, k_thread_stack_t *stack, size_t stack_size, int prio,
+			const struct k_work_queue_config *cfg)
+{
+	ARG_UNUSED(stack);
+	ARG_UNUSED(stack_size);
+	ARG_UNUSED(prio);
+	ARG_UNUSED(cfg);
+	queue->started = true;
+}
@@ -0,0 +1,131 @@
+#ifndef BLEND_SIM_H_
+#define BLEND_SIM_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <bluetooth/scan.h>
+
+/*
+ * BLEnd discrete-event simulator
+ *
+ * The BLEnd sources are compiled once and run for every simulated node. Their static variables
+ * are linked into the sim_node_data and sim_node_bss sections, and each node keeps its own copy
+ * of the two, which is swapped in before the node runs (sim_node_enter). All nodes share one
+ * simulated clock in microseconds; each node sees it through its boot time and clock drift.
+ * Events run one at a time in time order, so a handler always runs to completion.
+ */
+
+/** Delay from submitting a work item to its handler, in microseconds. */
+#define SIM_WORK_LATENCY_US 50
+/** Delay of an HCI event or command between the controller and the host, in microseconds. */
+#define SIM_HCI_LATENCY_US 100
+/** Delay from starting an advertising set to its first event, in microseconds. */
+#define SIM_ADV_START_US 250
+/** Largest payload a simulated beacon carries. */
+#define SIM_ADV_DATA_MAX (BT_GAP_ADV_MAX_ADV_DATA_LEN + CONFIG_BLEND_BEACON_DATA_MAX)
+
+enum sim_event_type {
+	SIM_EV_BOOT,         /* node powers up and runs the firmware boot sequence */
+	SIM_EV_TIMER,        /* k_timer expiry, obj is the timer */
+	SIM_EV_WORK,         /* work item handler, obj is the work item */
+	SIM_EV_ADV,          /* advertising event of the node's set */
+	SIM_EV_ADV_END,      /* the controller ends the advertising window */
+	SIM_EV_RX,           /* end of a transmission, arg is its air record */
+	SIM_EV_SCAN_TIMEOUT, /* the controller ends the scan window */
+	SIM_EV_SCAN_CB,      /* scan timeout callback of the host */
+};
+
+/** @brief Advertising set of a node, as the controller holds it. */
+struct sim_adv {
+	bool created;
+	bool running;
+	uint32_t gen;        /* bumped by start and stop, so stale events are dropped */
+	uint32_t options;    /* BT_LE_ADV_OPT_* */
+	uint32_t interval;   /* 0.625 ms units */
+	uint8_t num_events;  /* 0 for no limit */
+	int64_t end_us;      /* end of the window from its timeout, 0 for no limit */
+	uint8_t sent;        /* events of the running window */
+	uint8_t data[SIM_ADV_DATA_MAX];
+	uint8_t data_len;
+	const struct bt_le_ext_adv_cb *cb;
+};
+
+/** @brief Scanner of a node. */
+struct sim_scan {
+	bool running;
+	bool listed;         /* in the list of scanners the radio model checks */
+	uint32_t gen;
+	struct bt_le_scan_param param;
+	int64_t start_us, end_us; /* current or last window, end_us is INT64_MAX while running */
+	struct bt_scan_cb *cb;
+	struct bt_le_scan_cb *timeout_cb;
+	uint8_t filter[BT_GAP_ADV_MAX_ADV_DATA_LEN];
+	uint8_t filter_len;
+	bool filter_on;
+};
+
+/** @brief One simulated node. */
+struct sim_node {
+	int id;
+	bt_addr_le_t addr;
+	int64_t boot_us;
+	double drift;        /* local time runs (1 + drift) as fast as the simulated time */
+	uint8_t *image;      /* the node's copy of sim_node_data and sim_node_bss */
+	struct sim_adv adv;
+	struct sim_scan scan;
+	int64_t tx_start_us[2], tx_end_us[2]; /* last two advertising events, for half duplex */
+	uint64_t scan_us, tx_us;              /* radio on-time, for the duty cycle */
+	uint32_t adv_events, rx_count;
+};
+
+/** @brief Radio model settings of a run. */
+struct sim_radio_config {
+	double loss;         /* probability that a clean reception is lost anyway */
+	int8_t rssi;         /* RSSI of every reception */
+	bool overlap;        /* count the events that overlap another node's, see overlapped */
+};
+
+extern struct sim_node *sim_nodes;
+extern int sim_node_count;
+extern struct sim_radio_config sim_radio;
+extern int sim_verbosity;
+
+/* simulated time and event queue, sim.c */
+int64_t sim_now_us(void);
+void sim_schedule(int64_t t_us, enum sim_event_type type, int node, void *obj, uint32_t arg);
+struct sim_node *sim_node_current(void);
+void sim_node_enter(struct sim_node *node);
+int64_t sim_local_to_global_us(const struct sim_node *node, int64_t local_us);
+int64_t sim_local_us(const struct sim_node *node);
+uint64_t sim_random(void);
+double sim_random_unit(void);
+
+int sim_init(int nodes);
+void sim_reset(uint64_t seed);
+void sim_run(int64_t until_us);
+void sim_free(void);
+
+/* firmware boot sequence of a node, main.c */
+void sim_node_boot(struct sim_node *node);
+
+/* radio model, radio.c */
+int sim_radio_init(int nodes);
+void sim_radio_reset(void);
+void sim_radio_free(void);
+void sim_radio_event(struct sim_node *node, enum sim_event_type type, uint32_t arg);
+void sim_radio_finish(int64_t end_us);
+
+/** @brief Radio counters of a run. */
+struct sim_radio_stats {
+	uint64_t pdus;       /* PDUs sent, primary and auxiliary */
+	uint64_t collided;   /* PDUs that overlapped another on the same channel */
+	uint64_t received;   /* beacons handed to a scanner's filter */
+	uint64_t overlapped; /* advertising events that overlapped another node's in time */
+};
+
+void sim_radio_stats_get(struct sim_radio_stats *stats);
+
+/* first discovery of every ordered pair, main.c */
+void sim_heard(const struct sim_node *listener, const struct sim_node *sender);
+
+#endif
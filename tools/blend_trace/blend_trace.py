@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""
+blend_trace: decoder of the BLEnd CTF trace
+
+usage: blend_trace.py <trace> [--zephyr-base <dir>] [--summary]
+
+<trace> is the CTF stream a tracing backend wrote (channel0_0 of the posix backend, or the
+bytes read from the UART or RAM backend), or a directory of such streams. The stream is decoded
+with babeltrace2 against Zephyr's CTF metadata extended with blend.tsdl. Every BLEnd event is
+printed with its time; --summary prints one line per epoch instead: the time the radio spent
+scanning and advertising, and the beacons matched.
+
+Requires the babeltrace2 Python bindings (bt2), as Zephyr's scripts/tracing/parse_ctf.py does.
+"""
+
+import argparse
+import os
+import shutil
+import sys
+import tempfile
+from pathlib import Path
+
+TSDL = Path(__file__).resolve().parent / "blend.tsdl"
+ZEPHYR_METADATA = Path("subsys") / "tracing" / "ctf" / "tsdl" / "metadata"
+END_REASONS = {0: "timeout", 1: "stopped", 2: "connected"}
+ROLES = {0: "central", 1: "peripheral"}
+
+
+def addr_str(field):
+    val = [int(x) for x in field["val"]]
+    kind = "random" if int(field["type"]) == 1 else "public"
+    return ":".join(f"{b:02X}" for b in reversed(val)) + f" ({kind})"
+
+
+def describe(name, f):
+    """Formats the fields of one BLEnd event."""
+    if name == "blend_epoch":
+        return f"epoch {f['epoch']}, {f['late_us']} us late"
+    if name == "blend_scan_on":
+        return f"scan on, up to {f['duration_ms']} ms"
+    if name == "blend_scan_off":
+        return f"scan off, {END_REASONS.get(int(f['reason']), f['reason'])}"
+    if name == "blend_adv_on":
+        return f"advertise on, {f['events']} events, up to {f['duration_ms']} ms"
+    if name == "blend_adv_off":
+        return (f"advertise off, {END_REASONS.get(int(f['reason']), f['reason'])}, "
+                f"{f['sent']} events")
+    if name == "blend_match":
+        flags = int(f["flags"])
+        return (f"match {addr_str(f['peer'])} rssi {f['rssi']}"
+                f"{' connectable' if flags & 1 else ''}{' new' if flags & 2 else ''}")
+    if name == "blend_connected":
+        return (f"connected {addr_str(f['peer'])} as {ROLES.get(int(f['role']), f['role'])}"
+                f"{', err ' + str(f['err']) if int(f['err']) else ''}")
+    if name == "blend_disconnected":
+        return f"disconnected {addr_str(f['peer'])}, reason {f['reason']}"
+    return name
+
+
+def prepare(trace, zephyr_base, workdir):
+    """Puts the streams next to the combined metadata, as babeltrace2 expects."""
+    metadata = (zephyr_base / ZEPHYR_METADATA).read_text()
+    (workdir / "metadata").write_text(metadata + "\n" + TSDL.read_text())
+    streams = [p for p in trace.iterdir() if p.is_file() and p.name != "metadata"] \
+        if trace.is_dir() else [trace]
+    for stream in streams:
+        shutil.copy(stream, workdir / stream.name)
+
+
+def events(workdir):
+    """Yields (time in ns, name, payload) of every BLEnd event."""
+    import bt2
+
+    for msg in bt2.TraceCollectionMessageIterator(str(workdir)):
+        if type(msg) is not bt2._EventMessageConst:
+            continue
+        name = msg.event.name
+        if name.startswith("blend_"):
+            yield msg.default_clock_snapshot.ns_from_origin, name, msg.event.payload_field
+
+
+class Epoch:
+    def __init__(self, number, start_ns, late_us):
+        self.number, self.start_ns, self.late_us = number, start_ns, late_us
+        self.scan_ns = self.adv_ns = 0
+        self.matches = self.new = 0
+
+
+def summary(stream):
+    """Prints the radio time and matches of every epoch."""
+    epochs = []
+    scan_on = adv_on = None
+
+    print(f"{'epoch':>8s}{'start s':>12s}{'late us':>9s}{'scan ms':>9s}{'adv ms':>9s}"
+          f"{'matches':>9s}{'new':>5s}")
+    for t, name, f in stream:
+        if name == "blend_epoch":
+            epochs.append(Epoch(int(f["epoch"]), t, int(f["late_us"])))
+        if not epochs:
+            continue
+        e = epochs[-1]
+        if name == "blend_scan_on":
+            scan_on = t
+        elif name == "blend_scan_off" and scan_on is not None:
+            e.scan_ns += t - scan_on
+            scan_on = None
+        elif name == "blend_adv_on":
+            adv_on = t
+        elif name == "blend_adv_off" and adv_on is not None:
+            e.adv_ns += t - adv_on
+            adv_on = None
+        elif name == "blend_match":
+            e.matches += 1
+            e.new += bool(int(f["flags"]) & 2)
+    for e in epochs:
+        print(f"{e.number:8d}{e.start_ns / 1e9:12.3f}{e.late_us:9d}{e.scan_ns / 1e6:9.1f}"
+              f"{e.adv_ns / 1e6:9.1f}{e.matches:9d}{e.new:5d}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("trace", type=Path)
+    parser.add_argument("--zephyr-base", type=Path, default=os.environ.get("ZEPHYR_BASE"))
+    parser.add_argument("--summary", action="store_true", help="one line per epoch")
+    args = parser.parse_args()
+
+    if args.zephyr_base is None:
+        print("set ZEPHYR_BASE or --zephyr-base for the CTF metadata", file=sys.stderr)
+        return 2
+    with tempfile.TemporaryDirectory() as tmp:
+        workdir = Path(tmp)
+        prepare(args.trace, args.zephyr_base, workdir)
+        if args.summary:
+            summary(events(workdir))
+            return 0
+        for t, name, f in events(workdir):
+            print(f"[{t / 1e9:14.6f}] {describe(name, f)}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())